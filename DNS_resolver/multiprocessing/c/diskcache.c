@@ -0,0 +1,271 @@
+/**
+ * @file diskcache.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief persistent resolution cache in a shared memory-mapped file.
+ * @version 0.1
+ * @date 2021-05-31
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "diskcache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+#define DJB_OFFSET 5381U
+#define DISKCACHE_READ_TRIES 4
+
+static uint64_t hash_name(const char* hostname)
+{
+    uint64_t h = FNV_OFFSET;
+
+    for (const unsigned char* p = (const unsigned char*)hostname; *p; p++) {
+        h ^= *p;
+        h *= FNV_PRIME;
+    }
+    // 0 marks an empty slot
+    return h ? h : 1;
+}
+
+// independent of hash_name(), both have to collide for a false hit
+static uint32_t check_name(const char* hostname)
+{
+    uint32_t h = DJB_OFFSET;
+
+    for (const unsigned char* p = (const unsigned char*)hostname; *p; p++) {
+        h = h * 33 + *p;
+    }
+    return h;
+}
+
+// one consistent copy of a slot, FALSE if writers kept changing it
+static int slot_read(diskcache_slot* s, uint64_t* hash, uint32_t* check, int64_t* expires, uint64_t* ip)
+{
+    for (int tries = 0; tries < DISKCACHE_READ_TRIES; tries++) {
+        uint32_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+
+        if (seq & 1) {
+            // being written
+            continue;
+        }
+        *hash    = atomic_load_explicit(&s->hash, memory_order_relaxed);
+        *check   = atomic_load_explicit(&s->check, memory_order_relaxed);
+        *expires = atomic_load_explicit(&s->expires, memory_order_relaxed);
+        for (int i = 0; i < DISKCACHE_IP_WORDS; i++) {
+            ip[i] = atomic_load_explicit(&s->ip[i], memory_order_relaxed);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) == seq) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char* diskcache_path()
+{
+    const char* path = getenv(DISKCACHE_ENV);
+
+    return (path && *path) ? path : NULL;
+}
+
+// read the header of the file, laying a new one out first. Called with
+// the file lock held.
+static int file_header(int fd, uint32_t slots, diskcache_header* header, off_t* size)
+{
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+        perror("Error opening cache file");
+        return DISKCACHE_FAILURE;
+    }
+    *size = st.st_size;
+    if (st.st_size) {
+        if (pread(fd, header, sizeof(*header), 0) != sizeof(*header)) {
+            perror("Error reading cache file");
+            return DISKCACHE_FAILURE;
+        }
+        return DISKCACHE_SUCCESS;
+    }
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, DISKCACHE_MAGIC, sizeof(header->magic));
+    header->version   = DISKCACHE_VERSION;
+    header->slotCount = slots;
+    header->slotSize  = sizeof(diskcache_slot);
+    *size             = (off_t)(DISKCACHE_HEADER_SIZE + (size_t)slots * sizeof(diskcache_slot));
+    // sparse, slots read as empty until written
+    if (ftruncate(fd, *size) < 0 || pwrite(fd, header, sizeof(*header), 0) != sizeof(*header)) {
+        perror("Error creating cache file");
+        return DISKCACHE_FAILURE;
+    }
+
+    return DISKCACHE_SUCCESS;
+}
+
+int diskcache_open(diskcache* c, const char* path, uint32_t slots, long ttl, long negativeTtl)
+{
+    diskcache_header header;
+    struct stat      st;
+    off_t            size;
+    int              rc;
+
+    memset(c, 0, sizeof(*c));
+    c->ttl         = ttl;
+    c->negativeTtl = negativeTtl;
+    c->fd          = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, DISKCACHE_MODE);
+    if (c->fd < 0) {
+        perror("Error opening cache file");
+        return DISKCACHE_FAILURE;
+    }
+    // a file someone else can write could hand us any answer
+    if (fstat(c->fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid() ||
+        (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        fprintf(stderr, "Not using cache file %s: not a regular file only its owner can write\n", path);
+        close(c->fd);
+        return DISKCACHE_FAILURE;
+    }
+
+    // one process lays a new file out while the others wait
+    flock(c->fd, LOCK_EX);
+    rc = file_header(c->fd, slots, &header, &size);
+    flock(c->fd, LOCK_UN);
+    if (rc == DISKCACHE_FAILURE) {
+        close(c->fd);
+        return DISKCACHE_FAILURE;
+    }
+
+    if (memcmp(header.magic, DISKCACHE_MAGIC, sizeof(header.magic)) ||
+        header.version != DISKCACHE_VERSION || header.slotSize != sizeof(diskcache_slot) ||
+        !header.slotCount || (header.slotCount & (header.slotCount - 1)) ||
+        size < (off_t)(DISKCACHE_HEADER_SIZE + (size_t)header.slotCount * sizeof(diskcache_slot))) {
+        fprintf(stderr, "Not a cache file: %s\n", path);
+        close(c->fd);
+        return DISKCACHE_FAILURE;
+    }
+
+    c->mapSize = DISKCACHE_HEADER_SIZE + (size_t)header.slotCount * sizeof(diskcache_slot);
+    c->map     = mmap(NULL, c->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (c->map == MAP_FAILED) {
+        perror("Error mapping cache file");
+        close(c->fd);
+        return DISKCACHE_FAILURE;
+    }
+    // lookups land anywhere in the table
+    madvise(c->map, c->mapSize, MADV_RANDOM);
+    c->slots = (diskcache_slot*)((char*)c->map + DISKCACHE_HEADER_SIZE);
+    c->mask  = header.slotCount - 1;
+
+    return DISKCACHE_SUCCESS;
+}
+
+int diskcache_get(diskcache* c, const char* hostname, char* ip, size_t ipSize)
+{
+    uint64_t hash  = hash_name(hostname);
+    uint32_t check = check_name(hostname);
+    int64_t  now   = time(NULL);
+
+    for (uint32_t i = 0; i < DISKCACHE_PROBES; i++) {
+        diskcache_slot* s = &c->slots[(hash + i) & c->mask];
+        uint64_t        slotHash, words[DISKCACHE_IP_WORDS];
+        uint32_t        slotCheck;
+        int64_t         expires;
+
+        if (!slot_read(s, &slotHash, &slotCheck, &expires, words)) {
+            continue;
+        }
+        if (!slotHash) {
+            // end of the probe chain
+            break;
+        }
+        if (slotHash != hash || slotCheck != check) {
+            continue;
+        }
+        if (expires <= now) {
+            break;
+        }
+
+        memcpy(ip, words, ipSize < sizeof(words) ? ipSize : sizeof(words));
+        ip[ipSize - 1] = '\0';
+        if (ip[0]) {
+            atomic_fetch_add_explicit(&c->hits, 1, memory_order_relaxed);
+            return DISKCACHE_HIT;
+        }
+        atomic_fetch_add_explicit(&c->negativeHits, 1, memory_order_relaxed);
+        return DISKCACHE_NEGATIVE_HIT;
+    }
+    atomic_fetch_add_explicit(&c->misses, 1, memory_order_relaxed);
+
+    return DISKCACHE_MISS;
+}
+
+void diskcache_put(diskcache* c, const char* hostname, const char* ip)
+{
+    uint64_t        hash   = hash_name(hostname);
+    uint32_t        check  = check_name(hostname);
+    int64_t         now    = time(NULL);
+    diskcache_slot* victim = NULL;
+    uint32_t        seq    = 0;
+    int64_t         oldest = INT64_MAX;
+    uint64_t        words[DISKCACHE_IP_WORDS];
+
+    // the name's own slot, else the first free or expired one, else the
+    // one closest to expiring
+    for (uint32_t i = 0; i < DISKCACHE_PROBES; i++) {
+        diskcache_slot* s       = &c->slots[(hash + i) & c->mask];
+        uint32_t        slotSeq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        uint64_t        slotHash, slotWords[DISKCACHE_IP_WORDS];
+        uint32_t        slotCheck;
+        int64_t         expires;
+
+        if (!slot_read(s, &slotHash, &slotCheck, &expires, slotWords)) {
+            continue;
+        }
+        if (!slotHash || (slotHash == hash && slotCheck == check) || expires <= now) {
+            victim = s;
+            seq    = slotSeq;
+            break;
+        }
+        if (expires < oldest) {
+            oldest = expires;
+            victim = s;
+            seq    = slotSeq;
+        }
+    }
+
+    // the slot must not have changed since we picked it
+    if (!victim || (seq & 1) ||
+        !atomic_compare_exchange_strong_explicit(&victim->seq, &seq, seq + 1, memory_order_acq_rel,
+                                                 memory_order_relaxed)) {
+        atomic_fetch_add_explicit(&c->busy, 1, memory_order_relaxed);
+        return;
+    }
+
+    memset(words, 0, sizeof(words));
+    strncpy((char*)words, ip, sizeof(words) - 1);
+    atomic_store_explicit(&victim->hash, hash, memory_order_relaxed);
+    atomic_store_explicit(&victim->check, check, memory_order_relaxed);
+    atomic_store_explicit(&victim->expires, now + (ip[0] ? c->ttl : c->negativeTtl), memory_order_relaxed);
+    for (int i = 0; i < DISKCACHE_IP_WORDS; i++) {
+        atomic_store_explicit(&victim->ip[i], words[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&victim->seq, seq + 2, memory_order_release);
+    atomic_fetch_add_explicit(&c->stores, 1, memory_order_relaxed);
+}
+
+void diskcache_close(diskcache* c)
+{
+    munmap(c->map, c->mapSize);
+    close(c->fd);
+}
@@ -11,15 +11,28 @@
 #include "multi-lookup.h"
 
 #include <errno.h>
-#include <pthread.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "diskcache.h"
+#include "outbuf.h"
+#include "reader.h"
+#include "shmring.h"
 #include "util.h"
+#include "writer.h"
 
 #define TRUE 1U
 #define FALSE 0U
@@ -34,11 +47,30 @@
 #define MIN_REQUESTER_THREADS 1
 #define MAX_RESOLVER_THREADS 10
 #define MAX_REQUESTER_THREADS MAX_INPUT_FILES
-#define RESOLVER_PROCESSES_COUNT MAX_RESOLVER_THREADS
+#define RESOLVER_PROCESSES_COUNT MAX_RESOLVER_THREADS  // default pool size
+#define MAX_RESOLVER_PROCESSES 64
+#define MAX_THREADS_PER_PROCESS 64
 #define REQUESTER_PROCESSES_COUNT MAX_REQUESTER_THREADS
 #define MAX_IP_LENGTH INET6_ADDRSTRLEN
-#define USAGE "<inputFilePath> <outputFilePath>"
-#define NO_PAYLOAD EMPTY_STRING
+#define OPTSTRING "b:mp:q:t:P:"
+#define USAGE                                                                              \
+    "[-p resolverProcesses] [-q queueBound [-P maxResolverProcesses]] [-m [-b batchSize]] " \
+    "[-t threadsPerProcess] <inputFilePath> <outputFilePath>"
+#define POOL_TICK_MILLIS 50  // how often the supervisor looks at the pool
+#define POOL_HEADROOM 1.25  // processes per busy process Little's law asks for
+#define POOL_SHRINK_TICKS 10  // ticks with too many processes before retiring some
+#define POOL_STATS_BATCH 64  // lookups a resolver process counts before adding them to poolStats
+#define DEFAULT_BATCH_SIZE 64
+#define MAX_BATCH_SIZE 256
+#define FRAME_BYTES (64 * 1024)  // request frame: up to batchSize hostnames, each '\0' terminated
+#define RESULT_FRAME_BYTES (FRAME_BYTES + MAX_BATCH_SIZE * MAX_IP_LENGTH)  // hostname and IP pairs
+#define FRAME_WINDOW 2  // request frames a resolver process holds at once
+#define FRAME_RETRIES 1  // times a frame is sent again after its resolver process died
+#define FLUSH_BYTES (64 * 1024)
+#define SHARD_NAME "%s.shard%d"
+#define MERGE_CHUNK (1 << 30)  // most bytes per copy_file_range(2) call
+#define MERGE_BUFFER_SIZE (64 * 1024)
+#define FLUSH_MILLIS 1000
 
 // internal error codes -- alter: make it an enum
 #define ERROR_GENERIC -1  // unused
@@ -52,26 +84,77 @@
 #define ERROR_PROCESS_JOINING -9
 #define ERROR_TOO_MANY_INPUT_FILES -10
 
+/**
+ * @brief a request frame the dispatcher keeps until it is answered, to send
+ *          it again if its resolver process dies.
+ */
+typedef struct frame_s {
+    char   data[FRAME_BYTES];
+    size_t length;
+    int    count;  // hostnames in it
+    int    attempts;  // times sent
+} frame;
+
+/**
+ * @brief the dispatcher's view of a resolver process in message mode.
+ */
+typedef struct worker_s {
+    int    pid;
+    int    fd;  // the dispatcher's end of the socketpair
+    frame  frames[FRAME_WINDOW];
+    frame* window[FRAME_WINDOW];  // sent and not answered, oldest first
+    int    inFlight;
+} worker;
+
+/**
+ * @brief lookup counters the resolver processes add to and the supervisor
+ *          reads, in shared memory.
+ */
+typedef struct pool_stats_s {
+    atomic_ullong lookups;
+    atomic_ullong nanos;  // time spent in lookups
+    atomic_int    idle[MAX_RESOLVER_PROCESSES];  // by pool slot, the process found the queue empty
+} pool_stats;
+
+/**
+ * @brief what a resolver thread of a hybrid process works with.
+ */
+typedef struct hybrid_thread_s {
+    pthread_t thread;
+    shmring*  queue;  // its process' queue
+    outbuf    output;  // its pending output lines
+    size_t    names;  // hostnames it resolved
+} hybrid_thread;
+
 // Global static variables
-static char*               myQ;
-static pthread_mutex_t*    myQLock;
-static pthread_mutex_t*    outputFileLock;
-static pthread_mutexattr_t myQLockAttr;
-static pthread_mutexattr_t outputFileLockAttr;
-static pthread_cond_t*     myQIsFull;
-static pthread_condattr_t  myQIsFullAttr;
-static char*               child_pid_str;
-static char                popped_element[MAX_NAME_LENGTH];
-static int                 resolving_pids[RESOLVER_PROCESSES_COUNT];
-static int                 requesting_pids[REQUESTER_PROCESSES_COUNT];
-static FILE*               outputfp = NULL;  //Holds the output file
-static int*                stillRequesting;
-static int                 numberOfInputFiles = 0;
+static shmring           requests;  // hostnames from the requesters to the resolvers
+static int               queueBound = QUEUE_BOUND;
+static char*             child_pid_str;
+static int               resolving_pids[MAX_RESOLVER_PROCESSES];  // by pool slot, 0 for a free one
+static int               requesting_pids[REQUESTER_PROCESSES_COUNT];
+static int               outputfd = -1;  //Holds the output file
+static int               shardfds[MAX_RESOLVER_PROCESSES];  // one output shard per pool slot
+static writer            outputWriter;  // this process' writer thread
+static const dnsbackend* resolver = NULL;  // from UTIL_BACKEND_ENV
+static diskcache         resultFile;  // results of earlier runs, mapped from disk
+static int               diskCaching = FALSE;
+static int               messagePassing = FALSE;  // -m: dispatcher and socketpairs, nothing shared
+static int               batchSize = 0;  // -b, DEFAULT_BATCH_SIZE unless given
+static worker            workers[MAX_RESOLVER_PROCESSES];
+static int               poolMin = RESOLVER_PROCESSES_COUNT;  // -p, the pre-forked resolver processes
+static int               poolMax = 0;  // -P, 0 for a fixed pool
+static pool_stats*       poolStats;
+static int               threadsPerProcess = 0;  // -t: hybrid mode, processes of resolver threads
+static input_map         inputMaps[MAX_INPUT_FILES];  // mapped before forking, shared by the hybrid processes
+static FILE*             dispatchInput = NULL;  // input file the dispatcher is reading
+static int               nextInputFile = 1;  // argv index of the next one
+static char              carriedName[MAX_NAME_LENGTH];  // read but not in the last frame
+static int               numberOfInputFiles = 0;
 
 /* utility functions */
 int get_process_num_from_PID(int pid)
 {
-    for (int i = 0; i < RESOLVER_PROCESSES_COUNT; i++) {
+    for (int i = 0; i < MAX_RESOLVER_PROCESSES; i++) {
         if (resolving_pids[i] == pid) {
             return i + 1;
         }
@@ -86,21 +169,6 @@ int get_process_num_from_PID(int pid)
     return 99;
 }
 
-char* qGet(int n)
-{
-    return myQ + (n * MAX_NAME_LENGTH);
-}
-
-void printBuffContent(char* x)
-{
-    printf("%s", x);
-    printf(" Queue content:");
-    for (int i = 0; i < QUEUE_BOUND; i++) {
-        printf("%s, ", qGet(i));
-    }
-    printf(" from [P%d]\n", get_process_num_from_PID(getpid()));
-}
-
 void error_handler(int error, char* str)
 {
     // All errors are recoverable and won't halt the program unless specified in the error's switch case
@@ -181,136 +249,184 @@ void error_handler(int error, char* str)
     }
 }
 
-/* queue management functions */
-int queue_init()
+/* output shard functions */
+int open_shard(const char* outputPath, int slot)
 {
-    // allocate myQ in shared memory
-    myQ = (char*)mmap(NULL,
-                      (sizeof(char*) * QUEUE_BOUND * MAX_NAME_LENGTH),
-                      PROT_READ | PROT_WRITE,
-                      MAP_SHARED | MAP_ANON,
-                      -1,
-                      0);
-    if (myQ == MAP_FAILED) {
+    char path[PATH_MAX];
+
+    if (shardfds[slot] >= 0) {
+        // a process in this slot before: its lines stay, the next
+        // process' are appended
+        return TRUE;
+    }
+    snprintf(path, sizeof(path), SHARD_NAME, outputPath, slot + 1);
+    shardfds[slot] = open(path, O_RDWR | O_CREAT | O_TRUNC | O_EXCL | O_APPEND | O_CLOEXEC, 0600);
+    if (shardfds[slot] < 0) {
+        error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, path);
         return FALSE;
     }
+    // only the descriptor is needed: nothing is left behind whatever
+    // happens to the run
+    unlink(path);
 
-    // ADD INVALID PAYLOAD IN ALL ELEMENTS
-    for (int i = 0; i < QUEUE_BOUND; i++) {
-        strcpy(&myQ[i], NO_PAYLOAD);
-        // confirm
-        if (strcmp(&myQ[i], NO_PAYLOAD)) {
-            return FALSE;
-        }
-    }
     return TRUE;
 }
 
-int queue_is_full()
+// copy a whole shard to the end of the output file
+static int append_shard(int shardfd, size_t* bytes)
 {
-    // scan all elements in my queue and see if it has any empty payload
-    for (int i = 0; i < QUEUE_BOUND; i++) {
-        if (!strcmp(qGet(i), NO_PAYLOAD)) {
-            return FALSE;
+    char    buffer[MERGE_BUFFER_SIZE];
+    loff_t  offset = 0;
+    ssize_t n;
+
+    // in the kernel, and shared extents where the file system has them
+    while ((n = copy_file_range(shardfd, &offset, outputfd, NULL, MERGE_CHUNK, 0)) > 0) {
+        *bytes += n;
+    }
+    if (n == 0) {
+        return TRUE;
+    }
+    if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) {
+        return FALSE;
+    }
+
+    // not between these files: copy the rest by hand
+    while ((n = pread(shardfd, buffer, sizeof(buffer), offset)) > 0) {
+        for (ssize_t done = 0, w; done < n; done += w) {
+            w = write(outputfd, buffer + done, n - done);
+            if (w < 0) {
+                return FALSE;
+            }
         }
+        offset += n;
+        *bytes += n;
     }
-    return TRUE;
+
+    return n == 0;
 }
 
-int queue_is_empty()
+// cut off a line a killed resolver process left half written at the end
+// of its shard, the next process in the slot appends after it
+static void trim_shard(int slot)
 {
-    // scan all elements in my queue and see if it has any non-empty payload
-    for (int i = 0; i < QUEUE_BOUND; i++) {
-        if (strcmp(qGet(i), NO_PAYLOAD) != 0) {
-            return FALSE;
+    char  buffer[MERGE_BUFFER_SIZE];
+    off_t end = lseek(shardfds[slot], 0, SEEK_END);
+
+    while (end > 0) {
+        size_t n    = end < (off_t)sizeof(buffer) ? (size_t)end : sizeof(buffer);
+        char*  last = NULL;
+
+        if (pread(shardfds[slot], buffer, n, end - n) != (ssize_t)n) {
+            return;
         }
+        for (char* p = buffer; (p = memchr(p, '\n', buffer + n - p)) != NULL; p++) {
+            last = p;
+        }
+        if (last) {
+            end -= buffer + n - last - 1;
+            break;
+        }
+        end -= n;
+    }
+    if (end != lseek(shardfds[slot], 0, SEEK_END) && ftruncate(shardfds[slot], end) == 0) {
+        fprintf(stderr, "Cut a half written line off output shard %d\n", slot + 1);
     }
-    return TRUE;
 }
 
-int queue_push(char* payload)
+// lines in every shard, what the resolver processes got out
+static unsigned long long shard_lines()
 {
-    // add payload at the end of my queue
-    for (int i = 0; i < QUEUE_BOUND; i++) {
-        // find the first element in queue with empty element
-        if (!strcmp(qGet(i), NO_PAYLOAD)) {
-            strcpy(qGet(i), payload);
-
-            // verify write
-            if (!strcmp(qGet(i), payload)) {
-                return TRUE;
-            }
-            else {
-                return FALSE;
+    char               buffer[MERGE_BUFFER_SIZE];
+    unsigned long long lines = 0;
+    ssize_t            n;
+
+    for (int i = 0; i < MAX_RESOLVER_PROCESSES; i++) {
+        for (off_t offset = 0; shardfds[i] >= 0 && (n = pread(shardfds[i], buffer, sizeof(buffer), offset)) > 0;
+             offset += n) {
+            for (char* p = buffer; (p = memchr(p, '\n', buffer + n - p)) != NULL; p++) {
+                lines++;
             }
         }
     }
-    return FALSE;
+
+    return lines;
 }
 
-char* queue_pop()
+int merge_shards()
 {
-    char temp_prev[MAX_NAME_LENGTH];
-    char temp_curr[MAX_NAME_LENGTH];
-
-    // pop the first element, and shift all other elements
-    // towards the front
-    strcpy(popped_element, qGet(0));
+    size_t bytes  = 0;
+    int    ok     = TRUE;
+    int    shards = 0;
 
-    strcpy(temp_prev, qGet(QUEUE_BOUND));
-    strcpy(qGet(QUEUE_BOUND), NO_PAYLOAD);
-
-    for (int i = QUEUE_BOUND - 1; i >= 0; i--) {
-        strcpy(temp_curr, qGet(i));
-        strcpy(qGet(i), temp_prev);
-        strcpy(temp_prev, temp_curr);
+    for (int i = 0; i < MAX_RESOLVER_PROCESSES; i++) {
+        if (shardfds[i] < 0) {
+            continue;
+        }
+        if (ok && !append_shard(shardfds[i], &bytes)) {
+            ok = FALSE;
+        }
+        close(shardfds[i]);
+        shards++;
+    }
+    if (ok) {
+        printf("main> merged %d output shards (%zu bytes)\n", shards, bytes);
     }
 
-    return popped_element;
+    return ok;
 }
 
 /* producer and consumer functions */
+void lookup_hostname(const char* hostname, char* ip, size_t ipSize)
+{
+    // an earlier run, or another resolver process, may have it
+    int cached = diskCaching ? diskcache_get(&resultFile, hostname, ip, ipSize) : DISKCACHE_MISS;
+
+    if (cached == DISKCACHE_NEGATIVE_HIT) {
+        error_handler(ERROR_BOGUS_HOSTNAME, (char*)hostname);
+    }
+    else if (cached == DISKCACHE_MISS) {
+        /* Lookup hostname and get all IPs found */
+        if (resolver->lookup(hostname, ip, ipSize) == UTIL_FAILURE) {
+            // can't resolve hostname. handle error, then continue.
+            error_handler(ERROR_BOGUS_HOSTNAME, (char*)hostname);
+
+            // set ip address to empty string to match program requirement
+            strncpy(ip, EMPTY_STRING, ipSize);
+        }
+        if (diskCaching) {
+            diskcache_put(&resultFile, hostname, ip);
+        }
+    }
+}
+
 void request(char* inputFile)
 {
     char  hostname[MAX_NAME_LENGTH];  //Holds the individual hostname
     FILE* inputfp = fopen(inputFile, "r");
 
-    // check input file stream
+    // check input file stream, nothing to read but the queue still has to
+    // be closed below
     if (!inputfp) {
         error_handler(ERROR_BOGUS_INPUT_FILE_PATH, inputFile);
-        return;
     }
-    printf("Req> reading %s from P%d\n",
-           inputFile,
-           get_process_num_from_PID(getpid()));
+    else {
+        printf("Req> reading %s from P%d\n",
+               inputFile,
+               get_process_num_from_PID(getpid()));
+    }
 
     /* Read File and Process*/
-    while (fscanf(inputfp, INPUTFS, hostname) > 0) {
+    while (inputfp && fscanf(inputfp, INPUTFS, hostname) > 0) {
         printf("Req> enqueuing %s\n", hostname);
 
-        // protect queue from being used by another thread
-        pthread_mutex_lock(myQLock);
-
-        while (queue_is_full()) {
-            // queue is full, sleep current process until signaled to wake up, and
-            // release the specified mutex lock (i.e. myQLock)
-            pthread_cond_wait(myQIsFull, myQLock);
-        }
-        // queue is not full, enqueue hostname at hand
-        if (queue_push(hostname) == FALSE) {
+        // sleeps while the queue is full
+        if (shmring_push(&requests, hostname) != SHMRING_SUCCESS) {
             error_handler(ERROR_FAILED_TO_ENQUEUE, hostname);
-
-            // release queue to be used by another thread
-            pthread_mutex_unlock(myQLock);
+            continue;
         }
         printf("Req> %s enqueued Successfully [P%d] \n",
                hostname,
                get_process_num_from_PID(getpid()));
-
-        // release queue to be used by another thread
-        pthread_mutex_unlock(myQLock);
-
-        // printBuffContent("Req>");
     }
 
     /* Close Input File */
@@ -325,97 +441,781 @@ void request(char* inputFile)
     if (getpid() == requesting_pids[0]) {
         // requesting parent is done. no more requesting.
         printf("Req> Done requesting!\n");
-        *stillRequesting = FALSE;
+        shmring_close(&requests);
+    }
+    exit(0);
+}
+
+// add a resolver process' lookup counters to the shared ones, a batch at
+// a time so the processes don't fight over the cache line
+static void publish_stats(unsigned long long* lookups, unsigned long long* nanos)
+{
+    if (*lookups) {
+        atomic_fetch_add_explicit(&poolStats->lookups, *lookups, memory_order_relaxed);
+        atomic_fetch_add_explicit(&poolStats->nanos, *nanos, memory_order_relaxed);
+        *lookups = 0;
+        *nanos   = 0;
+    }
+}
+
+void resolve(int shard)
+{
+    char               firstipstr[MAX_IP_LENGTH];
+    char               hostname[MAX_NAME_LENGTH];
+    outbuf             output;  // this process' pending output lines
+    int                rc;
+    struct timespec    start, end;
+    unsigned long long lookups = 0, nanos = 0;  // not in poolStats yet
+
+    // threads don't survive fork(), so every resolver process starts its
+    // own writer, on its own shard of the output. Appending: an earlier
+    // process in the same pool slot may have written to it.
+    if (writer_open(&outputWriter,
+                    shardfds[shard],
+                    OUTBUF_BUFFER_SIZE(FLUSH_BYTES),
+                    1 + WRITER_IN_FLIGHT,
+                    WRITER_APPEND) == WRITER_FAILURE) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+    outbuf_init(&output, &outputWriter, FLUSH_BYTES, FLUSH_MILLIS);
+
+    // sleeps while the queue is empty, until the requesters are done and
+    // it is drained
+    while (1) {
+        rc = shmring_try_pop(&requests, hostname, sizeof(hostname));
+        if (rc == SHMRING_EMPTY) {
+            // about to go idle: hand over what we have so lines don't sit
+            // in memory while there is no work
+            outbuf_flush(&output);
+            publish_stats(&lookups, &nanos);
+            atomic_store(&poolStats->idle[shard], TRUE);
+            rc = shmring_pop(&requests, hostname, sizeof(hostname));
+            atomic_store(&poolStats->idle[shard], FALSE);
+        }
+        if (rc == SHMRING_CLOSED || rc == SHMRING_RETIRED) {
+            break;
+        }
+
+        printf("Res> resolving %s\n", hostname);
+
+        // the supervisor sizes the pool by how long lookups take
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        lookup_hostname(hostname, firstipstr, sizeof(firstipstr));
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        nanos += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+        if (++lookups == POOL_STATS_BATCH) {
+            publish_stats(&lookups, &nanos);
+        }
+
+        // buffer the output line, handed to the writer thread in blocks
+        if (outbuf_append(&output, hostname, firstipstr) == OUTBUF_FAILURE) {
+            error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
+        }
+
+        printf("Res> [%s] resolved Successfully to [%s]\n", hostname, firstipstr);
+    }
+
+    // wait for this process' last block to reach the disk
+    outbuf_cleanup(&output);
+    if (writer_close(&outputWriter) == WRITER_FAILURE) {
+        error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
+    }
+    printf("Res> [P%d] writer done (%zu bytes in %zu blocks, %zu calls with %s)\n",
+           get_process_num_from_PID(getpid()),
+           outputWriter.bytes,
+           outputWriter.written,
+           outputWriter.calls,
+           writer_mode(&outputWriter));
+    if (diskCaching) {
+        printf("Res> [P%d] cache file: %zu hits, %zu negative hits, %zu misses, %zu stored (%zu dropped)\n",
+               get_process_num_from_PID(getpid()),
+               atomic_load(&resultFile.hits),
+               atomic_load(&resultFile.negativeHits),
+               atomic_load(&resultFile.misses),
+               atomic_load(&resultFile.stores),
+               atomic_load(&resultFile.busy));
+    }
+
+    if (rc == SHMRING_RETIRED) {
+        printf("Res> [P%d] retired\n", get_process_num_from_PID(getpid()));
     }
     exit(0);
 }
 
-void resolve()
+/* resolver pool functions */
+// fork a resolver process into a free pool slot
+static int spawn_resolver(const char* outputPath)
 {
-    char  firstipstr[MAX_IP_LENGTH];
-    char* hostname_fetched;
+    int slot = 0;
+    int pid;
+
+    while (resolving_pids[slot]) {
+        slot++;
+    }
+    if (!open_shard(outputPath, slot)) {
+        return FALSE;
+    }
+    // not to be printed again by the child from its copy of stdout
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        return FALSE;
+    }
+    if (pid == 0) {
+        resolving_pids[slot] = getpid();
+        resolve(slot);
+    }
+    resolving_pids[slot] = pid;
+    printf("main> created resolving process #%d [%d]\n", slot + 1, pid);
+
+    return TRUE;
+}
+
+unsigned long long supervise(const char* outputPath)
+{
+    shmring_snapshot   now, last;
+    unsigned long long lookups, nanos, lastLookups = 0, lastNanos = 0, lines, lost = 0;
+    struct timespec    tick = {0, POOL_TICK_MILLIS * 1000000L};
+    double             latency = 0;  // seconds per lookup, lately
+    int                size = 0, smallest = poolMin, largest = poolMin, forked = 0, retired = 0, died = 0;
+    int                surplusTicks = 0;
+    int                status, pid;
+
+    for (int i = 0; i < poolMin; i++) {
+        if (!spawn_resolver(outputPath)) {
+            error_handler(ERROR_PROCESS_CREATION, EMPTY_STRING);
+        }
+        size++;
+        forked++;
+    }
+    shmring_snapshot_get(&requests, &last);
 
     while (1) {
-        // lock queue
-        pthread_mutex_lock(myQLock);
-
-        if (getpid() == resolving_pids[0]) {
-            // only parent resolving process checks and signals for requesting process
-            // to avoide signaling too many requesting processes at once
-            if (!queue_is_full()) {
-                // signal that we have now an empty spot in the queue
-                pthread_cond_signal(myQIsFull);
+        int target, idle = 0;
+
+        nanosleep(&tick, NULL);
+
+        // reap whoever is done: retired or crashed resolver processes, or
+        // the requesters
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (int i = 0; i < MAX_RESOLVER_PROCESSES; i++) {
+                if (resolving_pids[i] == pid) {
+                    resolving_pids[i] = 0;
+                    atomic_store(&poolStats->idle[i], FALSE);
+                    size--;
+                    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+                        // whatever it took and had not written yet: the
+                        // name it was resolving and its buffered lines
+                        fprintf(stderr, "Resolver process [%d] died, the lines it had not written are lost\n", pid);
+                        trim_shard(i);
+                        died++;
+                    }
+                }
             }
         }
 
-        if (!queue_is_empty()) {
-            hostname_fetched = queue_pop();
-            // printf("Res> [P%d] fetched %s from queue\n", get_process_num_from_PID(getpid()), hostname_fetched);
+        shmring_snapshot_get(&requests, &now);
+        if (now.closed) {
+            // everyone leaves once the queue is drained. Names are left
+            // only if processes died, replace them.
+            if (!size && !now.depth) {
+                break;
+            }
+            while (now.depth && size < poolMin && spawn_resolver(outputPath)) {
+                size++;
+                forked++;
+            }
+            continue;
+        }
+        for (int i = 0; i < MAX_RESOLVER_PROCESSES; i++) {
+            idle += resolving_pids[i] && atomic_load(&poolStats->idle[i]);
+        }
 
-            // release queue to be used by another process
-            pthread_mutex_unlock(myQLock);
+        // Little's law: names arriving per second times seconds per
+        // lookup is how many processes are busy on average
+        lookups = atomic_load(&poolStats->lookups);
+        nanos   = atomic_load(&poolStats->nanos);
+        if (lookups > lastLookups) {
+            latency = (nanos - lastNanos) / 1e9 / (lookups - lastLookups);
+        }
+        lastLookups = lookups;
+        lastNanos   = nanos;
+        target      = (int)ceil((now.pushed - last.pushed) * (1000.0 / POOL_TICK_MILLIS) * latency * POOL_HEADROOM);
+        if (now.depth > size) {
+            // falling behind whatever the estimate says
+            target = target > size + size / 2 + 1 ? target : size + size / 2 + 1;
+        }
+        target = target < poolMin ? poolMin : target > poolMax ? poolMax : target;
+        last   = now;
+
+        if (target > size) {
+            surplusTicks = 0;
+            while (size < target && spawn_resolver(outputPath)) {
+                size++;
+                forked++;
+            }
+            printf("main> resolver pool grew to %d (queue depth %d, %.1f ms per lookup)\n",
+                   size,
+                   now.depth,
+                   latency * 1000);
+        }
+        else if (target < size - now.retiring && idle > now.retiring && ++surplusTicks >= POOL_SHRINK_TICKS) {
+            // only idle processes leave
+            int surplus = size - now.retiring - target;
+
+            surplus = surplus < idle - now.retiring ? surplus : idle - now.retiring;
+            shmring_retire(&requests, surplus);
+            retired += surplus;
+            surplusTicks = 0;
+            printf("main> resolver pool shrinking to %d (queue depth %d, %.1f ms per lookup)\n",
+                   size - now.retiring - surplus,
+                   now.depth,
+                   latency * 1000);
+        }
+        else if (target >= size - now.retiring) {
+            surplusTicks = 0;
+        }
+        smallest = size < smallest ? size : smallest;
+        largest  = size > largest ? size : largest;
+    }
 
-            printf("Res> resolving %s\n", hostname_fetched);
+    while (wait(NULL) > 0)
+        ;  // wait for the requesters to finish
+
+    printf("main> resolver pool: %d to %d processes, %d forked, %d retired, %d died\n",
+           smallest,
+           largest,
+           forked,
+           retired,
+           died);
+    if (died) {
+        // every name pushed should have its line in a shard
+        lines = shard_lines();
+        lost  = now.pushed > lines ? now.pushed - lines : 0;
+        if (lost) {
+            fprintf(stderr, "%llu of %llu hostnames lost with resolver processes that died\n",
+                    lost,
+                    (unsigned long long)now.pushed);
+        }
+    }
+    printf("Res> Done resolving!\n");
 
-            if (hostname_fetched) {
-                /* Lookup hostname and get all IPs found */
-                if (dnslookup(hostname_fetched, firstipstr, sizeof(firstipstr)) == UTIL_FAILURE) {
-                    // can't resolve hostname. handle error, then continue.
-                    error_handler(ERROR_BOGUS_HOSTNAME, hostname_fetched);
+    return lost;
+}
 
-                    // set ip address to empty string to match program requirement
-                    strncpy(firstipstr, EMPTY_STRING, sizeof(firstipstr));
+/* message passing functions */
+// fill a request frame from the input files, 0 once they are all read
+static int next_frame(char** argv, frame* f)
+{
+    size_t length;
+
+    f->length = 0;
+    f->count  = 0;
+    while (f->count < batchSize) {
+        if (!carriedName[0]) {
+            // next hostname, from the next readable input file if need be
+            while (!dispatchInput || fscanf(dispatchInput, INPUTFS, carriedName) <= 0) {
+                if (dispatchInput) {
+                    fclose(dispatchInput);
+                    printf("Req> Closed input file %s\n", argv[nextInputFile - 1]);
+                    dispatchInput = NULL;
+                }
+                if (nextInputFile > numberOfInputFiles) {
+                    carriedName[0] = '\0';
+                    return f->count;
                 }
+                dispatchInput = fopen(argv[nextInputFile++], "r");
+                if (!dispatchInput) {
+                    error_handler(ERROR_BOGUS_INPUT_FILE_PATH, argv[nextInputFile - 1]);
+                }
+            }
+        }
+
+        length = strlen(carriedName) + 1;
+        if (f->length + length > sizeof(f->data)) {
+            // full, it starts the next frame
+            break;
+        }
+        memcpy(f->data + f->length, carriedName, length);
+        f->length += length;
+        f->count++;
+        carriedName[0] = '\0';
+    }
 
-                // protect output file from being used by another process
-                pthread_mutex_lock(outputFileLock);
+    return f->count;
+}
 
-                // write to output file
-                fprintf((FILE*)outputfp, "%s,%s\n", hostname_fetched, firstipstr);
-                fflush((FILE*)outputfp);
+void work(int fd)
+{
+    static char request[FRAME_BYTES];
+    static char result[RESULT_FRAME_BYTES];
+    char        firstipstr[MAX_IP_LENGTH];
+    ssize_t     n;
+
+    // one result frame per request frame, in order, until the dispatcher
+    // hangs up
+    while ((n = recv(fd, request, sizeof(request), 0)) > 0) {
+        size_t used = 0;
+
+        for (char* hostname = request; hostname < request + n; hostname += strlen(hostname) + 1) {
+            printf("Res> resolving %s\n", hostname);
+            lookup_hostname(hostname, firstipstr, sizeof(firstipstr));
+            printf("Res> [%s] resolved Successfully to [%s]\n", hostname, firstipstr);
+
+            // the frame holds hostname and IP, each '\0' terminated
+            memcpy(result + used, hostname, strlen(hostname) + 1);
+            used += strlen(hostname) + 1;
+            memcpy(result + used, firstipstr, strlen(firstipstr) + 1);
+            used += strlen(firstipstr) + 1;
+        }
+        if (send(fd, result, used, MSG_NOSIGNAL) < 0) {
+            break;
+        }
+    }
+    // _exit(): exit() would rewind the input file the dispatcher is
+    // reading, through the FILE this process inherited
+    fflush(stdout);
+    _exit(n < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
 
-                // release output file to be used by another process
-                pthread_mutex_unlock(outputFileLock);
+// fork a resolver process connected to the dispatcher by a socketpair
+static int spawn_worker(int index)
+{
+    worker* w = &workers[index];
+    int     sv[2];
 
-                printf("Res> [%s] resolved Successfully to [%s]\n", hostname_fetched, firstipstr);
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        perror("Error creating socketpair");
+        return FALSE;
+    }
+    // not to be printed again by the child from its copy of stdout
+    fflush(stdout);
+    w->pid = fork();
+    if (w->pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return FALSE;
+    }
+    if (w->pid == 0) {
+        // the other processes' sockets must only stay open in the
+        // dispatcher, or they would not see it hang up
+        for (int i = 0; i < poolMin; i++) {
+            if (workers[i].fd >= 0) {
+                close(workers[i].fd);
             }
         }
-        else {
-            // release queue to be used by another process
-            pthread_mutex_unlock(myQLock);
+        close(sv[0]);
+        work(sv[1]);
+    }
+    close(sv[1]);
+    w->fd       = sv[0];
+    w->inFlight = 0;
+
+    return TRUE;
+}
+
+// the frame's hostnames as failed lookups
+static void fail_frame(outbuf* output, frame* f)
+{
+    for (char* hostname = f->data; hostname < f->data + f->length; hostname += strlen(hostname) + 1) {
+        error_handler(ERROR_BOGUS_HOSTNAME, hostname);
+        if (outbuf_append(output, hostname, EMPTY_STRING) == OUTBUF_FAILURE) {
+            error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
         }
+    }
+}
+
+// reap a resolver process that hung up and start another in its place,
+// sending it the frames the dead one held
+static void replace_worker(outbuf* output, int index, size_t* resent, size_t* lost)
+{
+    worker* w = &workers[index];
+    frame*  held[FRAME_WINDOW];
+    int     count = w->inFlight, kept = 0, spare = FRAME_WINDOW;
+    int     status;
+
+    close(w->fd);
+    w->fd = -1;
+    waitpid(w->pid, &status, 0);
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "Resolver process [%d] killed by signal %d\n", w->pid, WTERMSIG(status));
+    }
+    else {
+        fprintf(stderr, "Resolver process [%d] exited with %d\n", w->pid, WEXITSTATUS(status));
+    }
+    if (!spawn_worker(index)) {
+        error_handler(ERROR_PROCESS_CREATION, EMPTY_STRING);
+    }
+
+    // frames to send again first, in order, free ones after them
+    memcpy(held, w->window, sizeof(held));
+    for (int i = 0; i < FRAME_WINDOW; i++) {
+        frame* f = held[i];
+
+        if (i < count && f->attempts <= FRAME_RETRIES) {
+            w->window[kept++] = f;
+            continue;
+        }
+        if (i < count) {
+            // it may be what kills them
+            *lost += f->count;
+            fail_frame(output, f);
+        }
+        w->window[--spare] = f;
+    }
+
+    for (w->inFlight = 0; w->inFlight < kept; w->inFlight++) {
+        frame* f = w->window[w->inFlight];
+
+        f->attempts++;
+        *resent += 1;
+        send(w->fd, f->data, f->length, MSG_NOSIGNAL);
+    }
+}
 
-        // check if we should be terminating out of this loop
-        // we break if the queue is empty AND we are done requesting
-        pthread_mutex_lock(myQLock);
-        if (queue_is_empty() && *stillRequesting == FALSE) {
-            pthread_mutex_unlock(myQLock);
-            // terminate if queue is empty AND we are done requesting
+// hand a result frame's lines to the writer and retire its request frame
+static void take_results(outbuf* output, worker* w, char* result, size_t length)
+{
+    frame* answered = w->window[0];
+
+    for (char* hostname = result; hostname < result + length;) {
+        char* ip = hostname + strlen(hostname) + 1;
+
+        if (outbuf_append(output, hostname, ip) == OUTBUF_FAILURE) {
+            error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
+        }
+        hostname = ip + strlen(ip) + 1;
+    }
+
+    memmove(w->window, w->window + 1, (FRAME_WINDOW - 1) * sizeof(w->window[0]));
+    w->window[FRAME_WINDOW - 1] = answered;
+    w->inFlight--;
+}
+
+void dispatch(char** argv)
+{
+    static char   result[RESULT_FRAME_BYTES];
+    struct pollfd fds[MAX_RESOLVER_PROCESSES];
+    outbuf        output;
+    int           inputDone = FALSE;
+    size_t        frames = 0, names = 0, resent = 0, lost = 0;
+
+    for (int i = 0; i < poolMin; i++) {
+        workers[i].fd = -1;
+        for (int j = 0; j < FRAME_WINDOW; j++) {
+            workers[i].window[j] = &workers[i].frames[j];
+        }
+    }
+    for (int i = 0; i < poolMin; i++) {
+        if (!spawn_worker(i)) {
+            error_handler(ERROR_PROCESS_CREATION, EMPTY_STRING);
+        }
+        printf("main> created resolving process #%d [%d]\n", i + 1, workers[i].pid);
+    }
+
+    // only the dispatcher writes the output file, and only once the
+    // resolver processes are forked
+    if (writer_open(&outputWriter, outputfd, OUTBUF_BUFFER_SIZE(FLUSH_BYTES), 1 + WRITER_IN_FLIGHT, 0) ==
+        WRITER_FAILURE) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+    outbuf_init(&output, &outputWriter, FLUSH_BYTES, FLUSH_MILLIS);
+
+    while (1) {
+        int busy = 0;
+
+        // keep every resolver process's window full
+        for (int i = 0; i < poolMin; i++) {
+            worker* w = &workers[i];
+
+            while (!inputDone && w->inFlight < FRAME_WINDOW) {
+                frame* f = w->window[w->inFlight];
+
+                if (!next_frame(argv, f)) {
+                    inputDone = TRUE;
+                    break;
+                }
+                f->attempts = 1;
+                w->inFlight++;
+                frames++;
+                names += f->count;
+                // a resolver process that died is seen by poll()
+                send(w->fd, f->data, f->length, MSG_NOSIGNAL);
+            }
+            busy += w->inFlight;
+            fds[i].fd     = w->fd;
+            fds[i].events = POLLIN;
+        }
+        if (!busy) {
             break;
         }
-        else {
-            pthread_mutex_unlock(myQLock);
+
+        if (poll(fds, poolMin, -1) < 0) {
+            continue;
+        }
+        for (int i = 0; i < poolMin; i++) {
+            ssize_t n;
+
+            if (!fds[i].revents) {
+                continue;
+            }
+            n = recv(workers[i].fd, result, sizeof(result), MSG_DONTWAIT);
+            if (n > 0 && workers[i].inFlight) {
+                take_results(&output, &workers[i], result, n);
+            }
+            else if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+                replace_worker(&output, i, &resent, &lost);
+            }
         }
     }
+    printf("Req> Done requesting!\n");
 
+    // hanging up tells the resolver processes to exit
+    for (int i = 0; i < poolMin; i++) {
+        close(workers[i].fd);
+    }
     while (wait(NULL) > 0)
         ;  // wait for child processes to finish
 
-    if (getpid() == resolving_pids[0]) {
-        // requesting parent is done. no more requesting.
-        printf("Res> Done resolving!\n");
-        return;
+    outbuf_cleanup(&output);
+    if (writer_close(&outputWriter) == WRITER_FAILURE) {
+        error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
+    }
+    printf("main> dispatched %zu names in %zu frames to %d resolver processes, %zu frames resent, "
+           "%zu names lost with a resolver process\n",
+           names,
+           frames,
+           poolMin,
+           resent,
+           lost);
+    printf("Res> Done resolving!\n");
+}
+
+/* hybrid functions */
+void* resolve_thread(void* arg)
+{
+    hybrid_thread* self = arg;
+    char           firstipstr[MAX_IP_LENGTH];
+    char           hostname[MAX_NAME_LENGTH];
+
+    // only this process' threads take from its queue
+    while (shmring_pop(self->queue, hostname, sizeof(hostname)) == SHMRING_SUCCESS) {
+        printf("Res> resolving %s\n", hostname);
+        lookup_hostname(hostname, firstipstr, sizeof(firstipstr));
+        if (outbuf_append(&self->output, hostname, firstipstr) == OUTBUF_FAILURE) {
+            error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
+        }
+        self->names++;
+        printf("Res> [%s] resolved Successfully to [%s]\n", hostname, firstipstr);
+    }
+    outbuf_cleanup(&self->output);
+
+    return NULL;
+}
+
+void hybrid_process(int slot)
+{
+    hybrid_thread threads[MAX_THREADS_PER_PROCESS];
+    shmring       queue;  // made after forking: this process' own
+    char          hostname[MAX_NAME_LENGTH];
+    const char*   name;
+    size_t        length, names = 0;
+
+    if (shmring_init(&queue, queueBound, MAX_NAME_LENGTH) == SHMRING_FAILURE ||
+        writer_open(&outputWriter,
+                    shardfds[slot],
+                    OUTBUF_BUFFER_SIZE(FLUSH_BYTES),
+                    threadsPerProcess + WRITER_IN_FLIGHT,
+                    0) == WRITER_FAILURE) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+    for (int i = 0; i < threadsPerProcess; i++) {
+        threads[i].queue = &queue;
+        threads[i].names = 0;
+        outbuf_init(&threads[i].output, &outputWriter, FLUSH_BYTES, FLUSH_MILLIS);
+        if (pthread_create(&threads[i].thread, NULL, resolve_thread, &threads[i])) {
+            error_handler(ERROR_PROCESS_CREATION, EMPTY_STRING);
+        }
+    }
+
+    // this process' share of every input file: the lines that start in
+    // its slot's byte range, one of -p equal ranges
+    for (int i = 0; i < numberOfInputFiles; i++) {
+        input_map*   m = &inputMaps[i];
+        input_cursor cursor;
+        size_t       begin, end;
+
+        if (!m->data) {
+            continue;
+        }
+        begin = reader_align(m, m->size * slot / poolMin);
+        end   = reader_align(m, m->size * (slot + 1) / poolMin);
+        reader_cursor_init(&cursor, m, begin, end);
+        while (reader_next(&cursor, &name, &length)) {
+            memcpy(hostname, name, length);
+            hostname[length] = '\0';
+            printf("Req> enqueuing %s\n", hostname);
+
+            // sleeps while the queue is full
+            if (shmring_push(&queue, hostname) != SHMRING_SUCCESS) {
+                error_handler(ERROR_FAILED_TO_ENQUEUE, hostname);
+                continue;
+            }
+            names++;
+        }
+    }
+    shmring_close(&queue);
+
+    for (int i = 0; i < threadsPerProcess; i++) {
+        pthread_join(threads[i].thread, NULL);
     }
+    if (writer_close(&outputWriter) == WRITER_FAILURE) {
+        error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
+    }
+    shmring_cleanup(&queue);
+    printf("Res> [P%d] %zu names resolved by %d threads:", slot + 1, names, threadsPerProcess);
+    for (int i = 0; i < threadsPerProcess; i++) {
+        printf(" %zu", threads[i].names);
+    }
+    printf("\n");
+
     exit(0);
 }
 
+void hybrid(char** argv)
+{
+    int pid;
+
+    // mapped once, the processes share the pages
+    for (int i = 0; i < numberOfInputFiles; i++) {
+        if (reader_map(&inputMaps[i], argv[i + 1]) == READER_FAILURE) {
+            error_handler(ERROR_BOGUS_INPUT_FILE_PATH, argv[i + 1]);
+        }
+    }
+
+    for (int slot = 0; slot < poolMin; slot++) {
+        if (!open_shard(argv[numberOfInputFiles + 1], slot)) {
+            error_handler(ERROR_PROCESS_CREATION, EMPTY_STRING);
+        }
+        // not to be printed again by the child from its copy of stdout
+        fflush(stdout);
+        pid = fork();
+        if (pid < 0) {
+            error_handler(ERROR_PROCESS_CREATION, EMPTY_STRING);
+        }
+        if (pid == 0) {
+            resolving_pids[slot] = getpid();
+            hybrid_process(slot);
+        }
+        resolving_pids[slot] = pid;
+        printf("main> created resolving process #%d [%d] with %d threads\n", slot + 1, pid, threadsPerProcess);
+    }
+
+    while (wait(NULL) > 0)
+        ;  // wait for child processes to finish
+    for (int i = 0; i < numberOfInputFiles; i++) {
+        reader_unmap(&inputMaps[i]);
+    }
+    printf("Res> Done resolving!\n");
+}
+
 /* Entry point of the program */
 int main(int argc, char* argv[])
 {
+    char* progname   = argv[0];
+    int   exitStatus = EXIT_SUCCESS;
+    int   opt;
+
+    /* Parse Options */
+    while ((opt = getopt(argc, argv, OPTSTRING)) != -1) {
+        switch (opt) {
+            case 'b':
+                // hostnames per request frame
+                batchSize = atoi(optarg);
+                if (batchSize < 1 || batchSize > MAX_BATCH_SIZE) {
+                    fprintf(stderr, "Batch size must be between 1 and %d\n", MAX_BATCH_SIZE);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'm':
+                // a dispatcher process and message frames instead of the
+                // shared queue
+                messagePassing = TRUE;
+                break;
+
+            case 'p':
+                // resolver processes forked up front, the least the pool has
+                poolMin = atoi(optarg);
+                if (poolMin < 1 || poolMin > MAX_RESOLVER_PROCESSES) {
+                    fprintf(stderr, "Resolver processes must be between 1 and %d\n", MAX_RESOLVER_PROCESSES);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'P':
+                // the most the pool grows to
+                poolMax = atoi(optarg);
+                if (poolMax < 1 || poolMax > MAX_RESOLVER_PROCESSES) {
+                    fprintf(stderr, "Resolver processes must be between 1 and %d\n", MAX_RESOLVER_PROCESSES);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 't':
+                // resolver threads in each of the -p processes
+                threadsPerProcess = atoi(optarg);
+                if (threadsPerProcess < 1 || threadsPerProcess > MAX_THREADS_PER_PROCESS) {
+                    fprintf(stderr, "Threads per process must be between 1 and %d\n", MAX_THREADS_PER_PROCESS);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'q':
+                // slots in the shared queue, or in each process' queue with -t
+                queueBound = atoi(optarg);
+                if (queueBound < 1 || queueBound > SHMRING_MAX_CAPACITY) {
+                    fprintf(stderr, "Queue bound must be between 1 and %d\n", SHMRING_MAX_CAPACITY);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            default:
+                fprintf(stderr, "Usage:\n %s %s\n", progname, USAGE);
+                return EXIT_FAILURE;
+        }
+    }
+    // from here on argv holds only the input files and the output file
+    argc -= optind - 1;
+    argv += optind - 1;
+    // options a mode would silently ignore are refused instead
+    if (threadsPerProcess && messagePassing) {
+        fprintf(stderr, "-t can't be combined with -m\n");
+        return EXIT_FAILURE;
+    }
+    if (poolMax && (messagePassing || threadsPerProcess)) {
+        fprintf(stderr, "-P can't be combined with -m or -t\n");
+        return EXIT_FAILURE;
+    }
+    if (batchSize && !messagePassing) {
+        fprintf(stderr, "-b needs -m\n");
+        return EXIT_FAILURE;
+    }
+    if (!batchSize) {
+        batchSize = DEFAULT_BATCH_SIZE;
+    }
+    if (!poolMax) {
+        poolMax = poolMin;
+    }
+    if (poolMax < poolMin) {
+        fprintf(stderr, "The pool can't grow to fewer than %d resolver processes\n", poolMin);
+        return EXIT_FAILURE;
+    }
+
     /* Check Arguments */
     if (argc < MINARGS) {
         fprintf(stderr, "Not enough arguments: %d\n", (argc - 1));
-        fprintf(stderr, "Usage:\n %s %s\n", argv[0], USAGE);
+        fprintf(stderr, "Usage:\n %s %s\n", progname, USAGE);
         return EXIT_FAILURE;
     }
 
@@ -425,177 +1225,140 @@ int main(int argc, char* argv[])
         error_handler(ERROR_TOO_MANY_INPUT_FILES, EMPTY_STRING);
     }
 
-    // map synchronization mutexes, CVs, and any other common variables in shared memory
-    // to allow all processes to access them
-    myQLock         = (pthread_mutex_t*)mmap(NULL,
-                                     sizeof(*myQLock),
-                                     PROT_READ | PROT_WRITE,
-                                     MAP_SHARED | MAP_ANON,
-                                     -1,
-                                     0);
-    outputFileLock  = (pthread_mutex_t*)mmap(NULL,
-                                            sizeof(*outputFileLock),
-                                            PROT_READ | PROT_WRITE,
-                                            MAP_SHARED | MAP_ANON,
-                                            -1,
-                                            0);
-    myQIsFull       = (pthread_cond_t*)mmap(NULL,
-                                      sizeof(*myQIsFull),
-                                      PROT_READ | PROT_WRITE,
-                                      MAP_SHARED | MAP_ANON,
-                                      -1,
-                                      0);
-    stillRequesting = (int*)mmap(NULL,
-                                 sizeof(*stillRequesting),
-                                 PROT_READ | PROT_WRITE,
-                                 MAP_SHARED | MAP_ANON,
-                                 -1,
-                                 0);
-    outputfp        = (FILE*)mmap(NULL,
-                           sizeof(*outputfp),
-                           PROT_READ | PROT_WRITE,
-                           MAP_SHARED | MAP_ANON,
-                           -1,
-                           0);
-
-    // init mutexes attributes
-    pthread_mutexattr_init(&myQLockAttr);
-    pthread_mutexattr_setpshared(&myQLockAttr, PTHREAD_PROCESS_SHARED);
-    pthread_mutexattr_init(&outputFileLockAttr);
-    pthread_mutexattr_setpshared(&outputFileLockAttr, PTHREAD_PROCESS_SHARED);
-
-    // init mutex locks
-    pthread_mutex_init(myQLock, &myQLockAttr);
-    pthread_mutex_init(outputFileLock, &outputFileLockAttr);
-
-    // init conditional variables attributes
-    pthread_condattr_init(&myQIsFullAttr);
-    pthread_condattr_setpshared(&myQIsFullAttr, PTHREAD_PROCESS_SHARED);
-
-    // init conditional variables
-    pthread_cond_init(myQIsFull, &myQIsFullAttr);
-
-    // init requests queue
-    if (!queue_init()) {
+    // the requests queue, mapped shared before forking along with its
+    // lock and futex words
+    if (!messagePassing && !threadsPerProcess && shmring_init(&requests, queueBound, MAX_NAME_LENGTH) == SHMRING_FAILURE) {
         // failed to init queue
         error_handler(ERROR_INIT, EMPTY_STRING);
         return FALSE;
     }
 
-    // set shared variables
-    *stillRequesting = TRUE;
-
-    // printBuffContent("main>");
-
     /* Open Output File */
-    outputfp = fopen(argv[numberOfInputFiles + 1], "w");
-    if (!outputfp) {
+    // only written at the end, when the shards are merged into it
+    outputfd = open(argv[numberOfInputFiles + 1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (outputfd < 0) {
         error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, argv[numberOfInputFiles + 1]);
         return FALSE;
     }
+    // every resolver process writes its own shard, opened when it is
+    // forked, no file is shared. With message passing only the dispatcher
+    // writes, in hybrid mode a process' threads share its shard.
+    for (int i = 0; i < MAX_RESOLVER_PROCESSES; i++) {
+        shardfds[i] = -1;
+    }
+    // lookup counters for the supervisor
+    poolStats = mmap(NULL, sizeof(*poolStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+    if (poolStats == MAP_FAILED) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+        return FALSE;
+    }
 
-    // creating requesting and resolving processes
-    int child_pid = fork();
-    switch (child_pid) {
-        case -1:
-            // failed forking
-            sprintf(child_pid_str, "%d", child_pid);
-            error_handler(ERROR_PROCESS_CREATION, child_pid_str);
-            break;
-
-        case 0:
-
-            // append parent requester process ID
-            requesting_pids[0] = getpid();
-            printf("main> created requesting process #1 [%d]\n", requesting_pids[0]);
+    // getaddrinfo() unless the environment names a stand-in for it. Set
+    // up before forking, the resolver processes inherit it.
+    resolver = dnsbackend_open(getenv(UTIL_BACKEND_ENV));
+    if (!resolver) {
+        return EXIT_FAILURE;
+    }
+    printf("main> resolving with the %s backend\n", resolver->name);
+    fflush(stdout);
+
+    // results of earlier runs. Mapped shared before forking, so every
+    // resolver process sees what the others store. Answers of a stand-in
+    // backend must not end up there.
+    if (resolver == &dnsbackend_getaddrinfo && diskcache_path() &&
+        diskcache_open(&resultFile,
+                       diskcache_path(),
+                       DISKCACHE_DEFAULT_SLOTS,
+                       DISKCACHE_DEFAULT_TTL,
+                       DISKCACHE_DEFAULT_NEGATIVE_TTL) == DISKCACHE_SUCCESS) {
+        diskCaching = TRUE;
+        printf("main> using cache file %s\n", diskcache_path());
+        // not to be printed again by every child from its copy of stdout
+        fflush(stdout);
+    }
 
-            // create remaining child requester processes
-            for (int i = 1; i < numberOfInputFiles; i++) {
-                int temp_pid = fork();
-                if (temp_pid < 0) {
-                    // error
-                    char* child_pid_str = NULL;
-                    sprintf(child_pid_str, "%d", child_pid);
-                    error_handler(ERROR_PROCESS_CREATION, child_pid_str);
-                }
-                else if (temp_pid == 0) {
-                    // last created child process. Append and run.
-                    requesting_pids[i] = getpid();
-                    printf("main> created requesting process #%d [%d]\n", i + 1, requesting_pids[i]);
-                    request(argv[i]);
-                    wait(NULL);
+    if (messagePassing) {
+        // one process reads the input and hands it out in frames, the
+        // resolver processes share nothing with it or each other
+        dispatch(argv);
+    }
+    else if (threadsPerProcess) {
+        // every process resolves its own part of the input with its own
+        // threads, queue and shard
+        hybrid(argv);
+        if (!merge_shards()) {
+            error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "merge failed");
+        }
+    }
+    else {
+        // creating requesting and resolving processes
+        int child_pid = fork();
+        switch (child_pid) {
+            case -1:
+                // failed forking
+                sprintf(child_pid_str, "%d", child_pid);
+                error_handler(ERROR_PROCESS_CREATION, child_pid_str);
+                break;
+
+            case 0:
+
+                // append parent requester process ID
+                requesting_pids[0] = getpid();
+                printf("main> created requesting process #1 [%d]\n", requesting_pids[0]);
+
+                // create remaining child requester processes
+                for (int i = 1; i < numberOfInputFiles; i++) {
+                    int temp_pid = fork();
+                    if (temp_pid < 0) {
+                        // error
+                        char* child_pid_str = NULL;
+                        sprintf(child_pid_str, "%d", child_pid);
+                        error_handler(ERROR_PROCESS_CREATION, child_pid_str);
+                    }
+                    else if (temp_pid == 0) {
+                        // last created child process. Append and run.
+                        requesting_pids[i] = getpid();
+                        printf("main> created requesting process #%d [%d]\n", i + 1, requesting_pids[i]);
+                        request(argv[i]);
+                        wait(NULL);
+                    }
+                    else {
+                        // parent. Create next child
+                        continue;
+                    }
                 }
-                else {
-                    // parent. Create next child
-                    continue;
+                request(argv[numberOfInputFiles]);
+                wait(NULL);
+                break;
+
+            default:
+                // the pool of resolver processes, grown and shrunk with
+                // the load until the queue is closed and drained
+                if (supervise(argv[numberOfInputFiles + 1])) {
+                    exitStatus = EXIT_FAILURE;
                 }
-            }
-            request(argv[numberOfInputFiles]);
-            wait(NULL);
-            break;
 
-        default:
-            // append parent resolver process ID
-            resolving_pids[0] = getpid();
-            printf("main> created resolving process #1 [%d]\n", resolving_pids[0]);
-
-            // create remaining child resolver processes
-            for (int i = 1; i < RESOLVER_PROCESSES_COUNT; i++) {
-                int temp_pid = fork();
-                if (temp_pid < 0) {
-                    // error
-                    sprintf(child_pid_str, "%d", child_pid);
-                    error_handler(ERROR_PROCESS_CREATION, child_pid_str);
-                }
-                else if (temp_pid == 0) {
-                    // last created child process. Append and run.
-                    resolving_pids[i] = getpid();
-                    printf("main> created resolving process #%d [%d]\n", i + 1, resolving_pids[i]);
-                    resolve();
-                    break;
-                }
-                else {
-                    // parent. Create next child
-                    continue;
+                // every resolver process is done with its shard
+                if (!merge_shards()) {
+                    error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "merge failed");
                 }
-            }
-
-            // parent completed creating child processes. run.
-            resolve();
-            break;
+                break;
+        }
     }
 
-    // printf("main> cleaning up");
-
-    // mutex locks clean up
-    pthread_mutex_destroy(myQLock);
-    pthread_mutex_destroy(outputFileLock);
-
-    // printf(".");
-
-    // mutex attributes clean up
-    pthread_mutexattr_destroy(&myQLockAttr);
-    pthread_mutexattr_destroy(&outputFileLockAttr);
-
-    // printf(".");
-
-    // conditional variables clean up
-    pthread_cond_destroy(myQIsFull);
-
-    // printf(".");
-
-    // CV attributes clean up
-    pthread_condattr_destroy(&myQIsFullAttr);
-
-    // printf(".");
+    // every other process is gone, see resolve()
+    shmring_cleanup(&requests);
 
     // Close Output File if it's open
-    if (outputfp) {
-        fclose(outputfp);
+    if (outputfd >= 0) {
+        close(outputfd);
+    }
+    if (diskCaching) {
+        diskcache_close(&resultFile);
     }
+    dnsbackend_close(resolver);
     printf("Done!\n");
-    // printBuffContent("main>");
     printf("main> All done! Goodbye.");// -yours truly, pid:%d\n", get_process_num_from_PID(getpid()));
 
-    return EXIT_SUCCESS;
+    return exitStatus;
 }
\ No newline at end of file
@@ -11,6 +11,9 @@
 
 #ifndef MULTI_LOOKUP_H
 #define MULTI_LOOKUP_H
+
+#include <stddef.h>
+
 /*********************/
 /* Utility functions */
 /*********************/
@@ -23,94 +26,149 @@
 int get_process_num_from_PID(int pid);
 
 /**
- * @brief get an element from the queue without removing it from
- *          the queue.
+ * @brief function to handle errors.
  * 
- * @param n the element index, where 0 is the first element.
- * @return char* the string stored in that element.
+ * @param error error code, internally defined as 
+ *              preprocessor directives in multi-lookup.c.
+ * @param str  Any supplemental string for the error to pass 
+ *             on to the user as feedback. 
+ * @return void* returns NULL upon complete execution.
  */
-char* qGet(int n);
+void error_handler(int error, char* str);
 
+/**************************/
+/* output shard functions */
+/**************************/
 /**
- * @brief print the content opf the bounded buffer to stdout.
+ * @brief create the output shard of a resolver pool slot next to the output
+ *          file, and unlink it at once so only the descriptor is left. A
+ *          slot keeps its shard when its process is replaced. Called before
+ *          forking the slot's process.
  * 
- * @param x a string to include before printing the content on
- *          the same line. Pass an empty string for none.
+ * @param outputPath path of the output file.
+ * @param slot the pool slot.
+ * @return int 1 if successful. 0 otherwise.
  */
-void printBuffContent(char* x);
+int open_shard(const char* outputPath, int slot);
 
 /**
- * @brief function to handle errors.
+ * @brief concatenate the shards into the output file once every resolver
+ *          process is done, with copy_file_range(2) where the file system
+ *          allows it, and close them.
  * 
- * @param error error code, internally defined as 
- *              preprocessor directives in multi-lookup.c.
- * @param str  Any supplemental string for the error to pass 
- *             on to the user as feedback. 
- * @return void* returns NULL upon complete execution.
+ * @return int 1 if successful. 0 otherwise.
  */
-void error_handler(int error, char* str);
+int merge_shards();
 
-/******************************/
-/* queue management functions */
-/******************************/
+/*******************************/
+/* producer and consumer funcs */
+/*******************************/
+/**
+ * @brief look a hostname up in the cache file, or with the resolver
+ *          backend, reporting a bogus hostname.
+ * 
+ * @param hostname the hostname.
+ * @param ip where to store its IP address, empty for a bogus hostname.
+ * @param ipSize size of ip.
+ */
+void lookup_hostname(const char* hostname, char* ip, size_t ipSize);
 
 /**
- * @brief initialize the bounded buffer (queue) to empty strings.
+ * @brief function to fetch each hostname in an input file,
+ *          and enqueue it into the shared FIFO queue, sleeping while it is
+ *          full. The first requesting process closes the queue once every
+ *          input file is read.
  * 
- * @return int returns 1 if successful. 0 otherwise.
+ * @param inputFile pointer to input file of type FILE*.
+ * @return void* returns NULL upon complete execution.
  */
-int queue_init();
+void request();
 
 /**
- * @brief check if the queue is empty (all elements are empty strings).
+ * @brief function to resolve hostnames stores in FIFO queue
+ *          and write each IP address to this process' output shard. Lines
+ *          are buffered and handed to this process' writer thread in blocks.
+ *          Sleeps while the queue is empty, exits once it is closed and
+ *          drained, or when the supervisor retires the process.
  * 
- * @return int 1 if queue is empty. 0 otherwise.
+ * @param shard index of this process' shard, its pool slot.
  */
-int queue_is_full();
+void resolve(int shard);
 
 /**
- * @brief check if the queue is full (no empty string elements).
+ * @brief supervisor of the resolver pool: pre-forks -p resolver processes
+ *          and, with -P, grows the pool when names arrive faster than it
+ *          resolves them, judged by the queue depth and by Little's law on
+ *          the arrival rate and the lookup latency, and retires idle
+ *          processes after a while with more than it needs. Replaces
+ *          processes that die, cutting a half written line off their shard;
+ *          the lines they had not written yet are lost. Returns once the
+ *          queue is closed and drained and every process in the pool is
+ *          gone.
  * 
- * @return int 1 if queue is full. 0 otherwise.
+ * @param outputPath path of the output file, next to which shards go.
+ * @return unsigned long long hostnames whose line was lost with a resolver
+ *          process that died, 0 if every one is in a shard.
  */
-int queue_is_full();
+unsigned long long supervise(const char* outputPath);
 
+/*****************************/
+/* message passing functions */
+/*****************************/
 /**
- * @brief push a new element to the queue.
+ * @brief resolver process of the message passing mode (-m): answers every
+ *          request frame of hostnames on its socket with a result frame of
+ *          hostname and IP pairs, until the dispatcher hangs up.
  * 
- * @param payload the payload to be enqueued.
- * @return int 1 upon successful push to the queue. 0 otherwise.
+ * @param fd this process' end of the socketpair.
  */
-int queue_push(char* payload);
+void work(int fd);
 
 /**
- * @brief pop the front element of the queue, and shift all
- *          elements towards the front fo the queue.
+ * @brief dispatcher of the message passing mode (-m): forks the resolver
+ *          processes, reads the input files into frames of up to batchSize
+ *          hostnames, keeps a window of frames in flight to every resolver
+ *          process and writes the results it gets back. A resolver process
+ *          that dies is replaced and its frames are sent again, once; a
+ *          frame that kills a second process is written as failed lookups.
  * 
- * @return char* the element popped from the front of the queue.
+ * @param argv the input files, from argv[1].
  */
-char* queue_pop();
+void dispatch(char** argv);
 
-/*******************************/
-/* producer and consumer funcs */
-/*******************************/
+/********************/
+/* hybrid functions */
+/********************/
 /**
- * @brief function to fetch each hostname in an input file,
- *          and enqueue it into our FIFO queue.
+ * @brief resolver thread of a hybrid process (-t): takes hostnames off its
+ *          process' queue and buffers the output lines for the process'
+ *          writer thread until the queue is closed and drained.
  * 
- * @param inputFile pointer to input file of type FILE*.
+ * @param arg the thread's hybrid_thread.
  * @return void* returns NULL upon complete execution.
  */
-void request();
+void* resolve_thread(void* arg);
 
 /**
- * @brief function to resolve hostnames stores in FIFO queue
- *          and write each IP address to the output file.
+ * @brief a hybrid process: starts -t resolver threads on a queue of its
+ *          own, feeds it the hostnames of its part of every input file and
+ *          exits once its threads are done. Only the threads of one process
+ *          ever contend for a queue lock.
  * 
- * @param outputfp pointer to output file of type FILE*.
- * @return void* returns NULL upon complete execution.
+ * @param slot index of the process, and of its part of the input and its
+ *          shard.
+ */
+void hybrid_process(int slot);
+
+/**
+ * @brief hybrid mode (-t): maps the input files, splits each into -p byte
+ *          ranges on line boundaries and forks a hybrid process for each,
+ *          then waits for them. Nothing is shared between the processes
+ *          but the read-only input mappings.
+ * 
+ * @param argv the input files, from argv[1].
  */
-void resolve();
+void hybrid(char** argv);
 
 /**
  * @brief main function.
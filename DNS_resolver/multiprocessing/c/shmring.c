@@ -0,0 +1,209 @@
+/**
+ * @file shmring.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief bounded FIFO queue of hostnames in shared memory.
+ * @version 0.1
+ * @date 2021-06-02
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "shmring.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define SHMRING_ALIGN 8
+
+static shmring_slot* slot_at(shmring* r, uint64_t counter)
+{
+    return (shmring_slot*)(r->slots + (counter % r->header->capacity) * r->header->slotSize);
+}
+
+// take the lock, from a process killed holding it if need be: its last
+// update either took effect with its last store or didn't at all
+static void lock(shmring_header* h)
+{
+    if (pthread_mutex_lock(&h->lock) == EOWNERDEAD) {
+        pthread_mutex_consistent(&h->lock);
+    }
+}
+
+// sleep, lock held, until word moves: it is read under the lock and only
+// bumped under it, so a bump between unlocking and sleeping makes the
+// kernel return at once rather than lose the wakeup
+static void sleep_on(shmring_header* h, uint32_t* word, int* sleepers)
+{
+    uint32_t seen = __atomic_load_n(word, __ATOMIC_RELAXED);
+
+    (*sleepers)++;
+    pthread_mutex_unlock(&h->lock);
+    syscall(SYS_futex, word, FUTEX_WAIT, seen, NULL, NULL, 0);
+    lock(h);
+    (*sleepers)--;
+}
+
+// bump word, lock held, and wake up to n of its sleepers
+static void wake(uint32_t* word, int sleepers, int n)
+{
+    __atomic_add_fetch(word, 1, __ATOMIC_RELAXED);
+    if (sleepers > 0) {
+        syscall(SYS_futex, word, FUTEX_WAKE, n, NULL, NULL, 0);
+    }
+}
+
+int shmring_init(shmring* r, int capacity, int maxLength)
+{
+    pthread_mutexattr_t lockAttr;
+    size_t              slotSize, headerSize;
+
+    memset(r, 0, sizeof(*r));
+    if (capacity < 1 || capacity > SHMRING_MAX_CAPACITY || maxLength < 1 || maxLength > UINT16_MAX) {
+        fprintf(stderr, "Bad queue size: %d slots of %d bytes\n", capacity, maxLength);
+        return SHMRING_FAILURE;
+    }
+    slotSize   = (sizeof(shmring_slot) + maxLength + SHMRING_ALIGN - 1) & ~(size_t)(SHMRING_ALIGN - 1);
+    headerSize = (sizeof(shmring_header) + SHMRING_ALIGN - 1) & ~(size_t)(SHMRING_ALIGN - 1);
+    r->mapSize = headerSize + (size_t)capacity * slotSize;
+    r->header  = mmap(NULL, r->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+    if (r->header == MAP_FAILED) {
+        perror("Error mapping queue");
+        r->header = NULL;
+        return SHMRING_FAILURE;
+    }
+    r->slots = (char*)r->header + headerSize;
+
+    // a fresh anonymous mapping is zeroed: head, tail and closed start at 0
+    r->header->capacity = capacity;
+    r->header->slotSize = slotSize;
+
+    pthread_mutexattr_init(&lockAttr);
+    pthread_mutexattr_setpshared(&lockAttr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&lockAttr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&r->header->lock, &lockAttr);
+    pthread_mutexattr_destroy(&lockAttr);
+
+    return SHMRING_SUCCESS;
+}
+
+int shmring_push(shmring* r, const char* payload)
+{
+    shmring_header* h      = r->header;
+    size_t          length = strlen(payload);
+    shmring_slot*   s;
+
+    if (length + 1 + sizeof(shmring_slot) > h->slotSize) {
+        return SHMRING_FAILURE;
+    }
+
+    lock(h);
+    while (h->tail - h->head == h->capacity && !h->closed) {
+        sleep_on(h, &h->notFull, &h->fullSleepers);
+    }
+    if (h->closed) {
+        pthread_mutex_unlock(&h->lock);
+        return SHMRING_CLOSED;
+    }
+
+    // filled first, pushed by moving the tail
+    s         = slot_at(r, h->tail);
+    s->length = length;
+    memcpy(s->payload, payload, length);
+    h->tail++;
+
+    wake(&h->notEmpty, h->emptySleepers, 1);
+    pthread_mutex_unlock(&h->lock);
+
+    return SHMRING_SUCCESS;
+}
+
+// the front payload, waiting for one if wait is set
+static int take(shmring* r, char* payload, size_t size, int wait)
+{
+    shmring_header* h = r->header;
+    shmring_slot*   s;
+    size_t          length;
+
+    lock(h);
+    while (wait && h->tail == h->head && !h->closed && !h->retiring) {
+        sleep_on(h, &h->notEmpty, &h->emptySleepers);
+    }
+    if (h->tail == h->head) {
+        int rc = h->closed ? SHMRING_CLOSED : SHMRING_EMPTY;
+
+        if (wait && rc == SHMRING_EMPTY && h->retiring) {
+            h->retiring--;
+            rc = SHMRING_RETIRED;
+        }
+        pthread_mutex_unlock(&h->lock);
+        return rc;
+    }
+
+    // copied first, popped by moving the head
+    s      = slot_at(r, h->head);
+    length = s->length < size ? s->length : size - 1;
+    memcpy(payload, s->payload, length);
+    payload[length] = '\0';
+    h->head++;
+
+    wake(&h->notFull, h->fullSleepers, 1);
+    pthread_mutex_unlock(&h->lock);
+
+    return SHMRING_SUCCESS;
+}
+
+int shmring_pop(shmring* r, char* payload, size_t size)
+{
+    return take(r, payload, size, 1);
+}
+
+int shmring_try_pop(shmring* r, char* payload, size_t size)
+{
+    return take(r, payload, size, 0);
+}
+
+void shmring_close(shmring* r)
+{
+    lock(r->header);
+    r->header->closed = 1;
+    wake(&r->header->notEmpty, r->header->emptySleepers, INT_MAX);
+    wake(&r->header->notFull, r->header->fullSleepers, INT_MAX);
+    pthread_mutex_unlock(&r->header->lock);
+}
+
+void shmring_retire(shmring* r, int n)
+{
+    lock(r->header);
+    r->header->retiring += n;
+    wake(&r->header->notEmpty, r->header->emptySleepers, INT_MAX);
+    pthread_mutex_unlock(&r->header->lock);
+}
+
+void shmring_snapshot_get(shmring* r, shmring_snapshot* s)
+{
+    shmring_header* h = r->header;
+
+    lock(h);
+    s->pushed   = h->tail;
+    s->depth    = h->tail - h->head;
+    s->retiring = h->retiring;
+    s->closed   = h->closed;
+    pthread_mutex_unlock(&h->lock);
+}
+
+void shmring_cleanup(shmring* r)
+{
+    if (!r->header) {
+        return;
+    }
+    pthread_mutex_destroy(&r->header->lock);
+    munmap(r->header, r->mapSize);
+    r->header = NULL;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file shmring.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for the bounded FIFO queue of hostnames the requesting
+ *          and resolving processes share. Everything lives in one anonymous
+ *          shared mapping made before forking: a header with the process
+ *          shared lock, the not-full/not-empty futex words and the head and
+ *          tail counters, followed by fixed-size slots holding a length and
+ *          the hostname. Pushing and popping touch one slot whatever the
+ *          capacity. A process may be killed at any point: the lock is
+ *          robust, every update takes effect with its last store, and
+ *          sleepers wait on bare futexes, which keep nothing in the mapping
+ *          a dead sleeper could leave half done. Shared condition variables
+ *          do, and hang every process after such a death.
+ * @version 0.1
+ * @date 2021-06-02
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHMRING_SUCCESS 0
+#define SHMRING_FAILURE -1
+#define SHMRING_CLOSED -2
+#define SHMRING_EMPTY -3
+#define SHMRING_RETIRED -4
+
+#define SHMRING_MAX_CAPACITY (1 << 24)
+
+/**
+ * @brief the start of the shared mapping. head and tail only grow, a slot's
+ *          index is the counter modulo the capacity.
+ */
+typedef struct shmring_header_s {
+    pthread_mutex_t lock;
+    uint32_t        notFull;  // futex word, bumped whenever a slot frees up
+    uint32_t        notEmpty;  // futex word, bumped whenever a payload arrives
+    int             fullSleepers;  // too high after a sleeper is killed,
+    int             emptySleepers;  // which only costs a needless wakeup
+    uint64_t        head;  // next slot to pop
+    uint64_t        tail;  // next slot to push
+    uint32_t        capacity;
+    uint32_t        slotSize;  // bytes, length prefix included
+    int             closed;  // no more pushes
+    int             retiring;  // poppers asked to leave, see shmring_retire()
+} shmring_header;
+
+/**
+ * @brief a consistent view of the ring, see shmring_snapshot().
+ */
+typedef struct shmring_snapshot_s {
+    uint64_t pushed;  // payloads ever pushed
+    int      depth;  // payloads waiting
+    int      retiring;
+    int      closed;
+} shmring_snapshot;
+
+/**
+ * @brief one slot, padded to the slot size.
+ */
+typedef struct shmring_slot_s {
+    uint16_t length;
+    char     payload[];
+} shmring_slot;
+
+/**
+ * @brief a process' handle on the ring, copied into children by fork().
+ */
+typedef struct shmring_s {
+    shmring_header* header;
+    char*           slots;
+    size_t          mapSize;
+} shmring;
+
+/**
+ * @brief map and initialize a ring. Call before forking.
+ *
+ * @param r the handle to fill in.
+ * @param capacity number of slots.
+ * @param maxLength longest payload, terminating '\0' included.
+ * @return int SHMRING_SUCCESS, or SHMRING_FAILURE.
+ */
+int shmring_init(shmring* r, int capacity, int maxLength);
+
+/**
+ * @brief add a payload at the end of the ring, sleeping while it is full.
+ *
+ * @param r the ring.
+ * @param payload '\0' terminated, shorter than maxLength.
+ * @return int SHMRING_SUCCESS, SHMRING_FAILURE if the payload is too long,
+ *          SHMRING_CLOSED if the ring was closed.
+ */
+int shmring_push(shmring* r, const char* payload);
+
+/**
+ * @brief remove the front payload of the ring, sleeping while it is empty.
+ *
+ * @param r the ring.
+ * @param payload where to copy it, '\0' terminated.
+ * @param size size of payload, at least maxLength.
+ * @return int SHMRING_SUCCESS, SHMRING_CLOSED once the ring is closed and
+ *          drained, or SHMRING_RETIRED if the caller was picked to leave by
+ *          shmring_retire().
+ */
+int shmring_pop(shmring* r, char* payload, size_t size);
+
+/**
+ * @brief remove the front payload of the ring if there is one.
+ *
+ * @param r the ring.
+ * @param payload where to copy it, '\0' terminated.
+ * @param size size of payload, at least maxLength.
+ * @return int SHMRING_SUCCESS, SHMRING_EMPTY, or SHMRING_CLOSED once the ring
+ *          is closed and drained.
+ */
+int shmring_try_pop(shmring* r, char* payload, size_t size);
+
+/**
+ * @brief say that nothing more will be pushed, waking every process
+ *          sleeping on the ring.
+ *
+ * @param r the ring.
+ */
+void shmring_close(shmring* r);
+
+/**
+ * @brief ask n poppers to leave: the next n that find the ring empty get
+ *          SHMRING_RETIRED, sleeping ones are woken for it. The caller
+ *          should not ask for more than are idle.
+ *
+ * @param r the ring.
+ * @param n how many.
+ */
+void shmring_retire(shmring* r, int n);
+
+/**
+ * @brief read the ring's counters under its lock.
+ *
+ * @param r the ring.
+ * @param s where to store them.
+ */
+void shmring_snapshot_get(shmring* r, shmring_snapshot* s);
+
+/**
+ * @brief destroy the lock and unmap the ring. Call once, after every
+ *          other process is done with it.
+ *
+ * @param r the ring.
+ */
+void shmring_cleanup(shmring* r);
+
+#endif /* SHMRING_H */
@@ -0,0 +1,425 @@
+/**
+ * @file synthetic.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief stand-in resolver backends: a synthetic one with a configurable
+ *          latency distribution and failure rate, and a null one.
+ * @version 0.1
+ * @date 2021-06-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "synthetic.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <strings.h>
+#include <time.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+#define UNIT_SCALE (1.0 / 9007199254740992.0)  // 2^-53
+#define TWO_PI 6.283185307179586
+#define SYNTHETIC_MAX_TOKENS 32
+#define SYNTHETIC_SEPARATORS " \t\r\n"
+
+/**
+ * @brief a name of the hosts file and its first address.
+ */
+typedef struct synthetic_host_s {
+    uint64_t hash;  // 0 if the slot is empty
+    char*    name;
+    char     ip[INET6_ADDRSTRLEN];
+} synthetic_host;
+
+// set up by synthetic_init(), only read while lookups run
+static synthetic_host* hosts        = NULL;  // NULL: every name resolves
+static size_t          hostSlots    = 0;
+static size_t          hostCount    = 0;
+static int             distribution = SYNTHETIC_FIXED;
+static double          fastMillis   = 0;  // the fixed delay, the lognormal median or the fast mode
+static double          slowMillis   = 0;
+static double          sigma        = 0;
+static double          slowShare    = 0;
+static double          failureRate  = 0;
+static uint64_t        seed         = 0;
+static char            nullIp[INET6_ADDRSTRLEN];  // empty: made from the name
+
+static uint64_t hash_name(const char* hostname)
+{
+    uint64_t h = FNV_OFFSET;
+
+    // names compare case-insensitively
+    for (const unsigned char* p = (const unsigned char*)hostname; *p; p++) {
+        h ^= (unsigned char)tolower(*p);
+        h *= FNV_PRIME;
+    }
+    // 0 marks an empty slot
+    return h ? h : 1;
+}
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+    return x ^ (x >> 31);
+}
+
+// the n-th uniform draw in (0, 1) of a lookup
+static double draw(uint64_t key, int n)
+{
+    return ((double)(mix(key + (uint64_t)n) >> 11) + 0.5) * UNIT_SCALE;
+}
+
+// in 198.18.0.0/15, set aside for benchmarks (RFC 2544)
+static void made_up_address(uint64_t hash, char* ip, int size)
+{
+    snprintf(ip,
+             size,
+             "198.%u.%u.%u",
+             18 + (unsigned)(hash >> 8 & 1),
+             (unsigned)(hash >> 16 & 0xff),
+             (unsigned)(hash >> 24 & 0xff));
+}
+
+static int is_address(const char* str)
+{
+    unsigned char addr[sizeof(struct in6_addr)];
+
+    return inet_pton(AF_INET, str, addr) == 1 || inet_pton(AF_INET6, str, addr) == 1;
+}
+
+static const synthetic_host* find_host(const char* hostname, uint64_t hash)
+{
+    if (!hosts) {
+        return NULL;
+    }
+    for (size_t i = hash & (hostSlots - 1); hosts[i].hash; i = (i + 1) & (hostSlots - 1)) {
+        if (hosts[i].hash == hash && !strcasecmp(hosts[i].name, hostname)) {
+            return &hosts[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void put_host(synthetic_host* table, size_t slots, const synthetic_host* host)
+{
+    size_t i = host->hash & (slots - 1);
+
+    while (table[i].hash) {
+        i = (i + 1) & (slots - 1);
+    }
+    table[i] = *host;
+}
+
+// twice the slots, kept at most half full
+static int grow_hosts()
+{
+    size_t          slots = hostSlots ? hostSlots * 2 : SYNTHETIC_MIN_SLOTS;
+    synthetic_host* table = calloc(slots, sizeof(synthetic_host));
+
+    if (!table) {
+        perror("Error on hosts table Calloc");
+        return UTIL_FAILURE;
+    }
+    for (size_t i = 0; i < hostSlots; i++) {
+        if (hosts[i].hash) {
+            put_host(table, slots, &hosts[i]);
+        }
+    }
+    free(hosts);
+    hosts     = table;
+    hostSlots = slots;
+
+    return UTIL_SUCCESS;
+}
+
+static int add_host(char* name, const char* ip)
+{
+    synthetic_host host;
+    size_t         length = strlen(name);
+
+    // names of a zone file end with the root
+    if (length > 1 && name[length - 1] == '.') {
+        name[length - 1] = '\0';
+    }
+    host.hash = hash_name(name);
+    if (find_host(name, host.hash)) {
+        // the first address of a name wins, like getaddrinfo()
+        return UTIL_SUCCESS;
+    }
+    if ((hostCount + 1) * 2 > hostSlots && grow_hosts() == UTIL_FAILURE) {
+        return UTIL_FAILURE;
+    }
+    host.name = strdup(name);
+    if (!host.name) {
+        perror("Error on hosts table Strdup");
+        return UTIL_FAILURE;
+    }
+    strncpy(host.ip, ip, sizeof(host.ip));
+    host.ip[sizeof(host.ip) - 1] = '\0';
+    put_host(hosts, hostSlots, &host);
+    hostCount++;
+
+    return UTIL_SUCCESS;
+}
+
+// "address name..." lines of a hosts file, or "name [ttl] [class] A|AAAA
+// address" records of a zone file
+static int load_hosts(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    char  line[SYNTHETIC_MAX_LINE];
+    int   rc;
+
+    if (!file) {
+        perror("Error opening hosts file");
+        return UTIL_FAILURE;
+    }
+    rc = grow_hosts();
+    while (rc == UTIL_SUCCESS && fgets(line, sizeof(line), file)) {
+        char* tokens[SYNTHETIC_MAX_TOKENS];
+        char* save;
+        char* token;
+        int   count = 0;
+
+        // comments run to the end of the line
+        line[strcspn(line, "#;")] = '\0';
+        token                     = strtok_r(line, SYNTHETIC_SEPARATORS, &save);
+        while (token && count < SYNTHETIC_MAX_TOKENS) {
+            tokens[count++] = token;
+            token           = strtok_r(NULL, SYNTHETIC_SEPARATORS, &save);
+        }
+        if (count < 2 || tokens[0][0] == '$') {
+            // blank, or a zone file directive
+            continue;
+        }
+
+        if (is_address(tokens[0])) {
+            for (int i = 1; i < count && rc == UTIL_SUCCESS; i++) {
+                rc = add_host(tokens[i], tokens[0]);
+            }
+            continue;
+        }
+        for (int i = 1; i + 1 < count; i++) {
+            if (!strcasecmp(tokens[i], "A") || !strcasecmp(tokens[i], "AAAA")) {
+                if (is_address(tokens[i + 1])) {
+                    rc = add_host(tokens[0], tokens[i + 1]);
+                }
+                break;
+            }
+        }
+    }
+    fclose(file);
+
+    return rc;
+}
+
+static int parse_latency(const char* value)
+{
+    if (sscanf(value, "fixed:%lf", &fastMillis) == 1) {
+        distribution = SYNTHETIC_FIXED;
+    }
+    else if (sscanf(value, "lognormal:%lf:%lf", &fastMillis, &sigma) == 2) {
+        distribution = SYNTHETIC_LOGNORMAL;
+    }
+    else if (sscanf(value, "bimodal:%lf:%lf:%lf", &fastMillis, &slowMillis, &slowShare) == 3) {
+        distribution = SYNTHETIC_BIMODAL;
+    }
+    else {
+        return UTIL_FAILURE;
+    }
+
+    return fastMillis >= 0 && slowMillis >= 0 && sigma >= 0 && slowShare >= 0 && slowShare <= 1 ? UTIL_SUCCESS
+                                                                                                   : UTIL_FAILURE;
+}
+
+// sleep until millis from now, a signal doesn't cut it short
+static void wait_millis(double millis)
+{
+    struct timespec until;
+    long long       nanos;
+
+    if (millis <= 0) {
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &until);
+    nanos         = (long long)(millis * 1000000) + until.tv_nsec;
+    until.tv_sec += nanos / 1000000000;
+    until.tv_nsec = nanos % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+    }
+}
+
+static int synthetic_lookup(const char* hostname, char* firstIPstr, int maxSize)
+{
+    uint64_t              hash = hash_name(hostname);
+    uint64_t              key  = mix(seed ^ hash);
+    const synthetic_host* host = find_host(hostname, hash);
+    double                millis;
+
+    switch (distribution) {
+        case SYNTHETIC_LOGNORMAL:
+            // the median times e^(sigma z), z standard normal by Box-Muller
+            millis = fastMillis * exp(sigma * sqrt(-2 * log(draw(key, 1))) * cos(TWO_PI * draw(key, 2)));
+            break;
+
+        case SYNTHETIC_BIMODAL:
+            millis = draw(key, 1) < slowShare ? slowMillis : fastMillis;
+            break;
+
+        default:
+            millis = fastMillis;
+            break;
+    }
+    wait_millis(millis < SYNTHETIC_MAX_MILLIS ? millis : SYNTHETIC_MAX_MILLIS);
+
+    // a name the hosts file doesn't have fails like NXDOMAIN, others now
+    // and then like a resolver that gave up
+    if (hosts && !host) {
+        fprintf(stderr, "Error looking up Address: %s\n", gai_strerror(EAI_NONAME));
+        return UTIL_FAILURE;
+    }
+    if (draw(key, 0) < failureRate) {
+        fprintf(stderr, "Error looking up Address: %s\n", gai_strerror(EAI_AGAIN));
+        return UTIL_FAILURE;
+    }
+
+    if (!host) {
+        made_up_address(hash, firstIPstr, maxSize);
+        return UTIL_SUCCESS;
+    }
+    strncpy(firstIPstr, host->ip, maxSize);
+    firstIPstr[maxSize - 1] = '\0';
+
+    return UTIL_SUCCESS;
+}
+
+static void synthetic_cleanup()
+{
+    for (size_t i = 0; i < hostSlots; i++) {
+        free(hosts[i].name);
+    }
+    free(hosts);
+    hosts     = NULL;
+    hostSlots = 0;
+    hostCount = 0;
+}
+
+static int synthetic_init(const char* options)
+{
+    char*       copy      = strdup(options ? options : "");
+    const char* hostsPath = NULL;
+    char*       save;
+    int         rc = UTIL_SUCCESS;
+
+    if (!copy) {
+        perror("Error on options Strdup");
+        return UTIL_FAILURE;
+    }
+    for (char* option = strtok_r(copy, ",", &save); option && rc == UTIL_SUCCESS; option = strtok_r(NULL, ",", &save)) {
+        char* value = strchr(option, '=');
+
+        if (value) {
+            *value++ = '\0';
+        }
+        if (!value) {
+            rc = UTIL_FAILURE;
+        }
+        else if (!strcmp(option, "hosts")) {
+            hostsPath = value;
+        }
+        else if (!strcmp(option, "latency")) {
+            rc = parse_latency(value);
+        }
+        else if (!strcmp(option, "fail")) {
+            failureRate = atof(value);
+            rc          = failureRate >= 0 && failureRate <= 1 ? UTIL_SUCCESS : UTIL_FAILURE;
+        }
+        else if (!strcmp(option, "seed")) {
+            seed = strtoull(value, NULL, 0);
+        }
+        else {
+            rc = UTIL_FAILURE;
+        }
+        if (rc == UTIL_FAILURE) {
+            fprintf(stderr, "Bad synthetic backend option: %s\n", option);
+        }
+    }
+
+    if (rc == UTIL_SUCCESS && hostsPath) {
+        rc = load_hosts(hostsPath);
+    }
+    if (rc == UTIL_SUCCESS) {
+        printf("synthetic backend: %s latency %.1f ms",
+               distribution == SYNTHETIC_LOGNORMAL ? "lognormal"
+               : distribution == SYNTHETIC_BIMODAL ? "bimodal"
+                                                   : "fixed",
+               fastMillis);
+        if (distribution == SYNTHETIC_LOGNORMAL) {
+            printf(" (sigma %.2f)", sigma);
+        }
+        if (distribution == SYNTHETIC_BIMODAL) {
+            printf(" or %.1f ms (%.1f%%)", slowMillis, slowShare * 100);
+        }
+        printf(", %.1f%% failures, seed %llu, ", failureRate * 100, (unsigned long long)seed);
+        if (hostsPath) {
+            printf("%zu names from %s\n", hostCount, hostsPath);
+        }
+        else {
+            printf("every name resolves\n");
+        }
+    }
+    else {
+        synthetic_cleanup();
+    }
+    free(copy);
+
+    return rc;
+}
+
+const dnsbackend synthetic_backend = {
+    .name    = "synthetic",
+    .init    = synthetic_init,
+    .lookup  = synthetic_lookup,
+    .cleanup = synthetic_cleanup,
+};
+
+static int null_init(const char* options)
+{
+    nullIp[0] = '\0';
+    if (!options) {
+        return UTIL_SUCCESS;
+    }
+    if (!is_address(options) || strlen(options) >= sizeof(nullIp)) {
+        fprintf(stderr, "Bad null backend address: %s\n", options);
+        return UTIL_FAILURE;
+    }
+    strcpy(nullIp, options);
+
+    return UTIL_SUCCESS;
+}
+
+static int null_lookup(const char* hostname, char* firstIPstr, int maxSize)
+{
+    if (!nullIp[0]) {
+        made_up_address(hash_name(hostname), firstIPstr, maxSize);
+        return UTIL_SUCCESS;
+    }
+    strncpy(firstIPstr, nullIp, maxSize);
+    firstIPstr[maxSize - 1] = '\0';
+
+    return UTIL_SUCCESS;
+}
+
+const dnsbackend null_backend = {
+    .name   = "null",
+    .init   = null_init,
+    .lookup = null_lookup,
+};
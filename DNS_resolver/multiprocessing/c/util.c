@@ -11,6 +11,15 @@
  */
 
 #include "util.h"
+#include "synthetic.h"
+
+/* One socket type: getaddrinfo() returns every address once
+ * instead of once per SOCK_STREAM, SOCK_DGRAM and SOCK_RAW
+ */
+static const struct addrinfo streamhints = {
+    .ai_family = AF_UNSPEC,
+    .ai_socktype = SOCK_STREAM,
+};
 
 int dnslookup(const char* hostname, char* firstIPstr, int maxSize){
 
@@ -29,7 +38,7 @@ int dnslookup(const char* hostname, char* firstIPstr, int maxSize){
 #endif
    
     /* Lookup Hostname */
-    addrError = getaddrinfo(hostname, NULL, NULL, &headresult);
+    addrError = getaddrinfo(hostname, NULL, &streamhints, &headresult);
     if(addrError){
 	fprintf(stderr, "Error looking up Address: %s\n",
 		gai_strerror(addrError));
@@ -81,3 +90,187 @@ int dnslookup(const char* hostname, char* firstIPstr, int maxSize){
 
     return UTIL_SUCCESS;
 }
+/* getaddrinfo() for one family, silent on failure */
+static int lookupfamily(const char* hostname, int family,
+			dnsaddress* addresses, int maxAddresses,
+			int* addrError){
+
+    struct addrinfo hints = streamhints;
+    struct addrinfo* headresult = NULL;
+    struct addrinfo* result = NULL;
+    const void* addr;
+    int count = 0;
+
+    hints.ai_family = family;
+    *addrError = getaddrinfo(hostname, NULL, &hints, &headresult);
+    if(*addrError){
+	return UTIL_FAILURE;
+    }
+    for(result=headresult; result != NULL && count < maxAddresses;
+	result = result->ai_next){
+	if(result->ai_family == AF_INET){
+	    addr = &((struct sockaddr_in*)result->ai_addr)->sin_addr;
+	}
+	else if(result->ai_family == AF_INET6){
+	    addr = &((struct sockaddr_in6*)result->ai_addr)->sin6_addr;
+	}
+	else{
+	    continue;
+	}
+	if(!inet_ntop(result->ai_family, addr, addresses[count].ip,
+		      sizeof(addresses[count].ip))){
+	    continue;
+	}
+	addresses[count].family = result->ai_family;
+	/* getaddrinfo() doesn't tell */
+	addresses[count].ttl = UTIL_TTL_UNKNOWN;
+	count++;
+    }
+
+    /* Cleanup */
+    freeaddrinfo(headresult);
+
+    return count;
+}
+
+int dnslookup_all(const char* hostname, int family,
+		  dnsaddress* addresses, int maxAddresses){
+
+    int addrError = 0;
+    int count;
+
+    count = lookupfamily(hostname, family, addresses, maxAddresses,
+			 &addrError);
+    if(count == UTIL_FAILURE){
+	fprintf(stderr, "Error looking up Address: %s\n",
+		gai_strerror(addrError));
+    }
+
+    return count;
+}
+
+/* Arguments and result of the AAAA half of dnslookup_dual() */
+struct dualquery {
+    const char* hostname;
+    dnsaddress addresses[UTIL_MAX_ADDRESSES];
+    int maxAddresses;
+    int count;
+    int addrError;
+};
+
+static void* lookupaaaa(void* arg){
+
+    struct dualquery* q = arg;
+
+    q->count = lookupfamily(q->hostname, AF_INET6, q->addresses,
+			    q->maxAddresses, &q->addrError);
+
+    return NULL;
+}
+
+int dnslookup_dual(const char* hostname,
+		   dnsaddress* addresses, int maxAddresses){
+
+    struct dualquery q;
+    pthread_t thread;
+    int threaded;
+    int addrError = 0;
+    int count;
+
+    /* AAAA on a thread of its own while we ask for A */
+    q.hostname = hostname;
+    q.maxAddresses = maxAddresses < UTIL_MAX_ADDRESSES ?
+	maxAddresses : UTIL_MAX_ADDRESSES;
+    threaded = !pthread_create(&thread, NULL, lookupaaaa, &q);
+    count = lookupfamily(hostname, AF_INET, addresses, maxAddresses,
+			 &addrError);
+    if(threaded){
+	pthread_join(thread, NULL);
+    }
+    else{
+	/* no thread to spare, one after the other then */
+	lookupaaaa(&q);
+    }
+
+    if(count == UTIL_FAILURE && q.count == UTIL_FAILURE){
+	fprintf(stderr, "Error looking up Address: %s\n",
+		gai_strerror(addrError));
+	return UTIL_FAILURE;
+    }
+    if(count == UTIL_FAILURE){
+	count = 0;
+    }
+
+    /* IPv4 first, then as many IPv6 as fit */
+    for(int i = 0; i < q.count && count < maxAddresses; i++){
+	addresses[count++] = q.addresses[i];
+    }
+
+    return count;
+}
+
+int dnsaddress_join(const dnsaddress* addresses, int count,
+		    char* str, int maxSize){
+
+    int used = 0;
+
+    str[0] = '\0';
+    for(int i = 0; i < count; i++){
+	int n = snprintf(str + used, maxSize - used, "%s%s",
+			 i ? "," : "", addresses[i].ip);
+	if(n < 0 || n >= maxSize - used){
+	    /* keep whole addresses only */
+	    str[used] = '\0';
+	    return UTIL_FAILURE;
+	}
+	used += n;
+    }
+
+    return UTIL_SUCCESS;
+}
+
+const dnsbackend dnsbackend_getaddrinfo = {
+    .name = "getaddrinfo",
+    .lookup = dnslookup,
+};
+
+/* Every backend dnsbackend_open() knows */
+static const dnsbackend* const backends[] = {
+    &dnsbackend_getaddrinfo,
+    &synthetic_backend,
+    &null_backend,
+};
+
+const dnsbackend* dnsbackend_open(const char* spec){
+
+    const char* options;
+    size_t length;
+
+    if(!spec || !*spec){
+	spec = dnsbackend_getaddrinfo.name;
+    }
+    /* "name" or "name:options" */
+    options = strchr(spec, ':');
+    length = options ? (size_t)(options - spec) : strlen(spec);
+    for(size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++){
+	if(strlen(backends[i]->name) != length ||
+	   strncmp(backends[i]->name, spec, length)){
+	    continue;
+	}
+	if(backends[i]->init &&
+	   backends[i]->init(options ? options + 1 : NULL) == UTIL_FAILURE){
+	    return NULL;
+	}
+	return backends[i];
+    }
+    fprintf(stderr, "Unknown resolver backend: %s\n", spec);
+
+    return NULL;
+}
+
+void dnsbackend_close(const dnsbackend* backend){
+
+    if(backend->cleanup){
+	backend->cleanup();
+    }
+}
@@ -25,6 +25,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
+#include <pthread.h>
 
 #define UTIL_FAILURE -1
 #define UTIL_SUCCESS 0
@@ -37,4 +38,74 @@ int dnslookup(const char* hostname,
 	      char* firstIPstr,
 	      int maxSize);
 
+/* Most addresses kept per hostname */
+#define UTIL_MAX_ADDRESSES 16
+#define UTIL_TTL_UNKNOWN -1
+
+/* One address of a hostname */
+typedef struct dnsaddress_s {
+    int family;  /* AF_INET or AF_INET6 */
+    int ttl;     /* seconds, UTIL_TTL_UNKNOWN if not known */
+    char ip[INET6_ADDRSTRLEN];
+} dnsaddress;
+
+/* Fuction to return every address found for hostname
+ * in family (AF_INET, AF_INET6 or AF_UNSPEC), at most
+ * maxAddresses of them, into the caller's addresses.
+ * Returns the number of addresses, UTIL_FAILURE if
+ * the lookup failed
+ */
+int dnslookup_all(const char* hostname,
+		  int family,
+		  dnsaddress* addresses,
+		  int maxAddresses);
+
+/* Fuction to look the IPv4 and IPv6 addresses of
+ * hostname up at the same time, IPv4 ones first.
+ * Returns the number of addresses, UTIL_FAILURE if
+ * both lookups failed
+ */
+int dnslookup_dual(const char* hostname,
+		   dnsaddress* addresses,
+		   int maxAddresses);
+
+/* Fuction to write count addresses into str as a
+ * comma separated list of at most maxSize bytes.
+ * Returns UTIL_FAILURE if they did not all fit
+ */
+int dnsaddress_join(const dnsaddress* addresses,
+		    int count,
+		    char* str,
+		    int maxSize);
+
+/* Environment variable naming the backend of a run,
+ * "name" or "name:options", getaddrinfo if unset
+ */
+#define UTIL_BACKEND_ENV "DNS_RESOLVER_BACKEND"
+
+/* A way of resolving hostnames. lookup keeps the
+ * contract of dnslookup() and is called from any
+ * number of threads at once. init gets the options
+ * of the backend spec, NULL if there are none. init
+ * and cleanup may be NULL
+ */
+typedef struct dnsbackend_s {
+    const char* name;
+    int (*init)(const char* options);
+    int (*lookup)(const char* hostname, char* firstIPstr, int maxSize);
+    void (*cleanup)(void);
+} dnsbackend;
+
+/* dnslookup() itself */
+extern const dnsbackend dnsbackend_getaddrinfo;
+
+/* Fuction to find the backend named by spec and set
+ * it up, NULL or "" selects getaddrinfo. Returns NULL
+ * if the backend is unknown or its options are bad
+ */
+const dnsbackend* dnsbackend_open(const char* spec);
+
+/* Fuction to release a backend from dnsbackend_open() */
+void dnsbackend_close(const dnsbackend* backend);
+
 #endif
@@ -0,0 +1,511 @@
+/**
+ * @file writer.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief output writer stage: a single thread writing pool buffers with
+ *          io_uring or writev(2).
+ * @version 0.1
+ * @date 2021-05-27
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "writer.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define TRUE 1
+#define FALSE 0
+
+/* glibc has no wrappers for the io_uring system calls */
+static int io_uring_setup(unsigned entries, struct io_uring_params* params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, const void* arg, unsigned count)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static void writer_uring_teardown(writer_uring* ring)
+{
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if (ring->cqRing && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    if (ring->fd >= 0) {
+        // also drops the registered buffers
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+static int writer_uring_setup(writer* w)
+{
+    writer_uring*          ring = &w->ring;
+    struct io_uring_params params;
+    struct iovec*          iov;
+
+    memset(&params, 0, sizeof(params));
+    ring->fd = io_uring_setup(WRITER_URING_ENTRIES, &params);
+    if (ring->fd < 0) {
+        ring->fd = -1;
+        return WRITER_FAILURE;
+    }
+
+    ring->entries    = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        // both rings live in one mapping
+        if (ring->cqRingSize > ring->sqRingSize) {
+            ring->sqRingSize = ring->cqRingSize;
+        }
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED) {
+        ring->sqRing = NULL;
+        writer_uring_teardown(ring);
+        return WRITER_FAILURE;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqRing = ring->sqRing;
+    }
+    else {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED) {
+            ring->cqRing = NULL;
+            writer_uring_teardown(ring);
+            return WRITER_FAILURE;
+        }
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes     = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        writer_uring_teardown(ring);
+        return WRITER_FAILURE;
+    }
+
+    ring->sqTail  = (unsigned*)((char*)ring->sqRing + params.sq_off.tail);
+    ring->sqMask  = (unsigned*)((char*)ring->sqRing + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*)((char*)ring->sqRing + params.sq_off.array);
+    ring->cqHead  = (unsigned*)((char*)ring->cqRing + params.cq_off.head);
+    ring->cqTail  = (unsigned*)((char*)ring->cqRing + params.cq_off.tail);
+    ring->cqMask  = (unsigned*)((char*)ring->cqRing + params.cq_off.ring_mask);
+    ring->cqes    = (struct io_uring_cqe*)((char*)ring->cqRing + params.cq_off.cqes);
+
+    // register the pool so the kernel maps it once instead of on every
+    // write. Needs locked memory, without it plain writes are used.
+    iov = malloc(sizeof(struct iovec) * w->bufferCount);
+    if (iov) {
+        for (int i = 0; i < w->bufferCount; i++) {
+            iov[i].iov_base = w->buffers[i].data;
+            iov[i].iov_len  = w->bufferSize;
+        }
+        ring->registered =
+            io_uring_register(ring->fd, IORING_REGISTER_BUFFERS, iov, (unsigned)w->bufferCount) == 0;
+        free(iov);
+    }
+
+    return WRITER_SUCCESS;
+}
+
+// take everything submitted so far. With wait set, sleep until there is
+// something or the writer closes.
+static writer_buffer* writer_take(writer* w, int wait, int* closing)
+{
+    writer_buffer* list;
+
+    pthread_mutex_lock(&w->lock);
+    while (wait && !w->pendingHead && !w->closing) {
+        pthread_cond_wait(&w->notEmpty, &w->lock);
+    }
+    list           = w->pendingHead;
+    w->pendingHead = NULL;
+    w->pendingTail = NULL;
+    *closing       = w->closing;
+    pthread_mutex_unlock(&w->lock);
+
+    // lay the buffers out in the order they were submitted
+    for (writer_buffer* b = list; b; b = b->next) {
+        b->offset = w->offset;
+        w->offset += (off_t)b->used;
+    }
+
+    return list;
+}
+
+// return a written (or dropped) buffer to the pool
+static void writer_release(writer* w, writer_buffer* b, int failed)
+{
+    if (!failed) {
+        w->bytes += b->used;
+        w->written++;
+    }
+    b->used    = 0;
+    b->written = 0;
+    b->busy    = FALSE;
+
+    pthread_mutex_lock(&w->lock);
+    if (failed) {
+        w->failed = TRUE;
+    }
+    b->next     = w->freeList;
+    w->freeList = b;
+    pthread_cond_signal(&w->notFull);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void writer_run_writev(writer* w)
+{
+    struct iovec   iov[WRITER_MAX_IOV];
+    writer_buffer* list;
+    int            closing;
+
+    while (1) {
+        list = writer_take(w, TRUE, &closing);
+        if (!list && closing) {
+            break;
+        }
+
+        while (list) {
+            writer_buffer* batch = list;
+            writer_buffer* b     = list;
+            ssize_t        rc;
+            int            n = 0;
+
+            // gather consecutive buffers into one call
+            for (; b && n < WRITER_MAX_IOV; b = b->next, n++) {
+                iov[n].iov_base = b->data + b->written;
+                iov[n].iov_len  = b->used - b->written;
+            }
+            list = b;
+
+            if (w->flags & WRITER_APPEND) {
+                rc = writev(w->fd, iov, n);
+            }
+            else {
+                rc = pwritev(w->fd, iov, n, batch->offset + (off_t)batch->written);
+            }
+            w->calls++;
+
+            if (rc < 0 && (errno == EINTR || errno == EAGAIN)) {
+                list = batch;
+                continue;
+            }
+            if (rc < 0) {
+                perror("Error writing output file");
+            }
+
+            // release what got out, a short write retries the rest
+            b = batch;
+            while (b != list) {
+                writer_buffer* next = b->next;
+                size_t         left = b->used - b->written;
+
+                if (rc >= 0 && (size_t)rc < left) {
+                    b->written += (size_t)rc;
+                    list = b;
+                    break;
+                }
+                rc = rc < 0 ? rc : rc - (ssize_t)left;
+                writer_release(w, b, rc < 0);
+                b = next;
+            }
+        }
+    }
+}
+
+// queue a write of what is left of the buffer on the submission ring
+static void writer_prep(writer* w, writer_buffer* b)
+{
+    writer_uring*        ring  = &w->ring;
+    unsigned             tail  = *ring->sqTail;
+    unsigned             index = tail & *ring->sqMask;
+    struct io_uring_sqe* sqe   = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = ring->registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd     = w->fd;
+    sqe->addr   = (uintptr_t)(b->data + b->written);
+    sqe->len    = (unsigned)(b->used - b->written);
+    // -1: write at the file position, O_APPEND makes that the end of file
+    sqe->off       = (w->flags & WRITER_APPEND) ? (__u64)-1 : (__u64)(b->offset + (off_t)b->written);
+    sqe->buf_index = (__u16)b->index;
+    sqe->user_data = (uintptr_t)b;
+    ring->sqArray[index] = index;
+    b->busy              = TRUE;
+
+    // publish the entry before the kernel can see the new tail
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void writer_run_uring(writer* w)
+{
+    writer_uring*  ring        = &w->ring;
+    writer_buffer* backlog     = NULL;  // taken, not on the ring yet
+    writer_buffer* backlogTail = NULL;
+    unsigned       inFlight    = 0;  // on the ring, not completed
+    // appends land wherever the end of file is when they run, in whatever
+    // order they complete: one at a time keeps the buffers, and a short
+    // write's remainder, in order
+    unsigned       depth       = (w->flags & WRITER_APPEND) ? 1 : ring->entries;
+    unsigned       unsubmitted = 0;  // on the ring, not passed to the kernel
+    int            closing     = FALSE;
+
+    while (1) {
+        // sleep for new buffers only while nothing is in flight, otherwise
+        // a completion wakes us up
+        writer_buffer* list = writer_take(w, !inFlight && !backlog, &closing);
+        if (list) {
+            if (backlogTail) {
+                backlogTail->next = list;
+            }
+            else {
+                backlog = list;
+            }
+            backlogTail = list;
+            while (backlogTail->next) {
+                backlogTail = backlogTail->next;
+            }
+        }
+        if (!backlog && !inFlight) {
+            if (closing) {
+                break;
+            }
+            continue;
+        }
+
+        // one submission for as many buffers as the ring has room for
+        while (backlog && inFlight < depth) {
+            writer_buffer* b = backlog;
+
+            backlog = b->next;
+            if (!backlog) {
+                backlogTail = NULL;
+            }
+            writer_prep(w, b);
+            inFlight++;
+            unsubmitted++;
+        }
+
+        int rc = io_uring_enter(ring->fd, unsubmitted, 1, IORING_ENTER_GETEVENTS);
+        w->calls++;
+        if (rc < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            // the ring is unusable: drop everything still in our hands
+            perror("Error submitting output writes");
+            for (int i = 0; i < w->bufferCount; i++) {
+                if (w->buffers[i].busy) {
+                    writer_release(w, &w->buffers[i], TRUE);
+                }
+            }
+            while (backlog) {
+                writer_buffer* next = backlog->next;
+                writer_release(w, backlog, TRUE);
+                backlog = next;
+            }
+            writer_uring_teardown(ring);
+            w->mode = "writev";
+
+            // and write whatever comes next with writev(2)
+            writer_run_writev(w);
+            return;
+        }
+        unsubmitted -= (unsigned)rc;
+
+        // reap completions
+        unsigned head = *ring->cqHead;
+        while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+            writer_buffer*       b   = (writer_buffer*)(uintptr_t)cqe->user_data;
+            int                  res = cqe->res;
+
+            head++;
+            inFlight--;
+            b->busy = FALSE;
+            if (res == -EINTR || res == -EAGAIN || (res >= 0 && b->written + (size_t)res < b->used)) {
+                // retry the rest first: it goes at its own offset, or is the
+                // only append in flight
+                b->written += res > 0 ? (size_t)res : 0;
+                b->next = backlog;
+                backlog = b;
+                if (!backlogTail) {
+                    backlogTail = b;
+                }
+            }
+            else {
+                if (res < 0) {
+                    errno = -res;
+                    perror("Error writing output file");
+                }
+                writer_release(w, b, res < 0);
+            }
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+static void* writer_main(void* arg)
+{
+    writer* w = arg;
+
+    if (w->ring.fd >= 0) {
+        writer_run_uring(w);
+    }
+    else {
+        writer_run_writev(w);
+    }
+
+    return NULL;
+}
+
+int writer_open(writer* w, int fd, size_t bufferSize, int bufferCount, int flags)
+{
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+    memset(w, 0, sizeof(*w));
+    w->fd          = fd;
+    w->flags       = flags;
+    w->ring.fd     = -1;
+    w->bufferCount = bufferCount;
+    w->offset      = 0;
+    w->mode        = "writev";
+
+    // page aligned buffers, as the kernel pins them when registered
+    w->bufferSize = (bufferSize + pageSize - 1) & ~(pageSize - 1);
+    w->pool       = aligned_alloc(pageSize, w->bufferSize * bufferCount);
+    w->buffers    = calloc(bufferCount, sizeof(writer_buffer));
+    if (!w->pool || !w->buffers) {
+        perror("Error on output buffer pool Malloc");
+        free(w->pool);
+        free(w->buffers);
+        return WRITER_FAILURE;
+    }
+    for (int i = bufferCount - 1; i >= 0; i--) {
+        w->buffers[i].data  = w->pool + w->bufferSize * i;
+        w->buffers[i].index = i;
+        w->buffers[i].next  = w->freeList;
+        w->freeList         = &w->buffers[i];
+    }
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->notEmpty, NULL);
+    pthread_cond_init(&w->notFull, NULL);
+
+    if (!(flags & WRITER_NO_URING)) {
+        // an old kernel or a seccomp filter: stay with writev(2)
+        if (writer_uring_setup(w) == WRITER_SUCCESS) {
+            w->mode = w->ring.registered ? "io_uring (registered buffers)" : "io_uring";
+        }
+    }
+
+    if (pthread_create(&w->thread, NULL, writer_main, w)) {
+        writer_uring_teardown(&w->ring);
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->notEmpty);
+        pthread_cond_destroy(&w->notFull);
+        free(w->pool);
+        free(w->buffers);
+        return WRITER_FAILURE;
+    }
+
+    return WRITER_SUCCESS;
+}
+
+writer_buffer* writer_get(writer* w)
+{
+    writer_buffer* b = NULL;
+
+    pthread_mutex_lock(&w->lock);
+    while (!w->freeList && !w->failed) {
+        // every buffer is queued: wait for the disk to catch up
+        pthread_cond_wait(&w->notFull, &w->lock);
+    }
+    if (!w->failed) {
+        b           = w->freeList;
+        w->freeList = b->next;
+        b->next     = NULL;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return b;
+}
+
+void writer_submit(writer* w, writer_buffer* b)
+{
+    pthread_mutex_lock(&w->lock);
+    if (!b->used) {
+        // nothing to write, straight back to the pool
+        b->next     = w->freeList;
+        w->freeList = b;
+        pthread_cond_signal(&w->notFull);
+    }
+    else {
+        b->next = NULL;
+        if (w->pendingTail) {
+            w->pendingTail->next = b;
+        }
+        else {
+            w->pendingHead = b;
+        }
+        w->pendingTail = b;
+        pthread_cond_signal(&w->notEmpty);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+int writer_close(writer* w)
+{
+    pthread_mutex_lock(&w->lock);
+    w->closing = TRUE;
+    pthread_cond_signal(&w->notEmpty);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_join(w->thread, NULL);
+
+    writer_uring_teardown(&w->ring);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->notEmpty);
+    pthread_cond_destroy(&w->notFull);
+    free(w->pool);
+    free(w->buffers);
+    w->pool    = NULL;
+    w->buffers = NULL;
+
+    return w->failed ? WRITER_FAILURE : WRITER_SUCCESS;
+}
+
+const char* writer_mode(const writer* w)
+{
+    return w->mode;
+}
@@ -0,0 +1,232 @@
+/**
+ * @file cache.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief lock-striped resolution cache with CLOCK eviction and TTLs.
+ * @version 0.1
+ * @date 2021-05-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static int64_t now_millis()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// FNV-1a, the top bits pick the shard and the low bits the bucket
+static uint64_t hash_name(const char* hostname)
+{
+    uint64_t h = FNV_OFFSET;
+
+    for (const unsigned char* p = (const unsigned char*)hostname; *p; p++) {
+        h ^= *p;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static cache_shard* shard_of(cache* c, uint64_t hash)
+{
+    return &c->shards[hash >> 58 & (CACHE_SHARDS - 1)];
+}
+
+// entry index of a hostname, -1 if the shard doesn't hold it. Called with
+// the shard lock.
+static int shard_find(cache_shard* s, uint64_t hash, const char* hostname)
+{
+    for (int i = s->buckets[hash & s->bucketMask]; i >= 0; i = s->entries[i].next) {
+        if (s->entries[i].hash == hash && !strcmp(s->entries[i].hostname, hostname)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// take entry i off its bucket chain. Called with the shard lock.
+static void shard_unlink(cache_shard* s, int i)
+{
+    int* link = &s->buckets[s->entries[i].hash & s->bucketMask];
+
+    while (*link != i) {
+        link = &s->entries[*link].next;
+    }
+    *link = s->entries[i].next;
+}
+
+// pick the entry to reuse in a full shard: the first one past its TTL or
+// not hit since the hand last went by. Called with the shard lock.
+static int shard_evict(cache_shard* s, int64_t now)
+{
+    while (1) {
+        cache_entry* e = &s->entries[s->hand];
+        int          i = s->hand;
+
+        s->hand = (s->hand + 1) % s->capacity;
+        if (e->referenced && e->expires > now) {
+            // second chance
+            e->referenced = 0;
+            continue;
+        }
+        shard_unlink(s, i);
+        free(e->hostname);
+        e->hostname = NULL;
+        s->evictions++;
+        return i;
+    }
+}
+
+int cache_init(cache* c, size_t entries, long ttlMillis, long negativeTtlMillis)
+{
+    int perShard = (int)((entries + CACHE_SHARDS - 1) / CACHE_SHARDS);
+    int buckets  = 1;
+
+    if (perShard < 1) {
+        perShard = 1;
+    }
+    // about one entry per bucket when full
+    while (buckets < perShard) {
+        buckets <<= 1;
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->ttlMillis         = ttlMillis;
+    c->negativeTtlMillis = negativeTtlMillis;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        cache_shard* s = &c->shards[i];
+
+        s->entries    = malloc(sizeof(cache_entry) * perShard);
+        s->buckets    = malloc(sizeof(int) * buckets);
+        s->capacity   = perShard;
+        s->bucketMask = buckets - 1;
+        if (!s->entries || !s->buckets) {
+            perror("Error on cache Malloc");
+            free(s->entries);
+            free(s->buckets);
+            while (i--) {
+                free(c->shards[i].entries);
+                free(c->shards[i].buckets);
+                pthread_mutex_destroy(&c->shards[i].lock);
+            }
+            return CACHE_FAILURE;
+        }
+        memset(s->buckets, -1, sizeof(int) * buckets);
+        pthread_mutex_init(&s->lock, NULL);
+    }
+
+    return CACHE_SUCCESS;
+}
+
+int cache_get(cache* c, const char* hostname, char* ip, size_t ipSize)
+{
+    uint64_t     hash = hash_name(hostname);
+    cache_shard* s    = shard_of(c, hash);
+    int          rc   = CACHE_MISS;
+    int          i;
+
+    pthread_mutex_lock(&s->lock);
+    i = shard_find(s, hash, hostname);
+    if (i < 0) {
+        s->misses++;
+    }
+    else if (s->entries[i].expires <= now_millis()) {
+        // stale, the caller looks it up again and cache_put() refreshes it
+        s->misses++;
+        s->expired++;
+    }
+    else {
+        cache_entry* e = &s->entries[i];
+
+        e->referenced = 1;
+        snprintf(ip, ipSize, "%s", e->ip);
+        if (e->ip[0]) {
+            s->hits++;
+            rc = CACHE_HIT;
+        }
+        else {
+            s->negativeHits++;
+            rc = CACHE_NEGATIVE_HIT;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return rc;
+}
+
+int cache_put(cache* c, const char* hostname, const char* ip)
+{
+    uint64_t     hash = hash_name(hostname);
+    cache_shard* s    = shard_of(c, hash);
+    int64_t      now  = now_millis();
+    cache_entry* e;
+    int          i;
+
+    pthread_mutex_lock(&s->lock);
+    i = shard_find(s, hash, hostname);
+    if (i < 0) {
+        char* copy = strdup(hostname);
+
+        if (!copy) {
+            pthread_mutex_unlock(&s->lock);
+            perror("Error on cache Malloc");
+            return CACHE_FAILURE;
+        }
+        i = s->used < s->capacity ? s->used++ : shard_evict(s, now);
+        e = &s->entries[i];
+        e->hash     = hash;
+        e->hostname = copy;
+        e->next     = s->buckets[hash & s->bucketMask];
+        s->buckets[hash & s->bucketMask] = i;
+    }
+    e             = &s->entries[i];
+    e->referenced = 0;
+    e->expires    = now + (ip[0] ? c->ttlMillis : c->negativeTtlMillis);
+    snprintf(e->ip, sizeof(e->ip), "%s", ip);
+    pthread_mutex_unlock(&s->lock);
+
+    return CACHE_SUCCESS;
+}
+
+void cache_stats_get(cache* c, cache_stats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        cache_shard* s = &c->shards[i];
+
+        pthread_mutex_lock(&s->lock);
+        stats->hits += s->hits;
+        stats->negativeHits += s->negativeHits;
+        stats->misses += s->misses;
+        stats->expired += s->expired;
+        stats->evictions += s->evictions;
+        stats->entries += s->used;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+void cache_cleanup(cache* c)
+{
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        cache_shard* s = &c->shards[i];
+
+        for (int j = 0; j < s->used; j++) {
+            free(s->entries[j].hostname);
+        }
+        free(s->entries);
+        free(s->buckets);
+        pthread_mutex_destroy(&s->lock);
+    }
+}
@@ -0,0 +1,140 @@
+/**
+ * @file cache.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for the resolution cache shared by the resolver
+ *          threads. The table is split in lock-striped shards of bounded
+ *          size, full shards evict with the CLOCK algorithm, and every
+ *          entry expires after its TTL. Names that did not resolve are
+ *          cached too, with a shorter TTL of their own.
+ * @version 0.1
+ * @date 2021-05-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CACHE_FAILURE -1
+#define CACHE_SUCCESS 0
+
+// cache_get() results
+#define CACHE_MISS 0
+#define CACHE_HIT 1
+#define CACHE_NEGATIVE_HIT 2  // cached as not resolving
+
+#define CACHE_SHARDS 64  // power of two
+#define CACHE_LINE_SIZE 64
+#define CACHE_DEFAULT_ENTRIES (64 * 1024)
+#define CACHE_DEFAULT_TTL 300  // seconds
+#define CACHE_DEFAULT_NEGATIVE_TTL 30
+
+/**
+ * @brief a cached hostname.
+ */
+typedef struct cache_entry_s {
+    uint64_t hash;
+    char*    hostname;
+    int64_t  expires;     // milliseconds, CLOCK_MONOTONIC
+    int      next;        // bucket chain, -1 terminated
+    int      referenced;  // CLOCK bit, set on every hit
+    char     ip[INET6_ADDRSTRLEN];  // empty if the name did not resolve
+} cache_entry;
+
+/**
+ * @brief one lock stripe: a chained hash table over a fixed entry array.
+ *          Shards start on their own cache line so threads working on
+ *          different ones don't contend on the same line.
+ */
+typedef struct cache_shard_s {
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t lock;
+    cache_entry*    entries;
+    int*            buckets;  // first entry of each chain, -1 if empty
+    int             bucketMask;
+    int             capacity;
+    int             used;  // entries filled so far, all of them once full
+    int             hand;  // CLOCK hand
+    size_t          hits;
+    size_t          negativeHits;
+    size_t          misses;
+    size_t          expired;  // misses on an entry past its TTL
+    size_t          evictions;
+} cache_shard;
+
+/**
+ * @brief the cache.
+ */
+typedef struct cache_s {
+    cache_shard shards[CACHE_SHARDS];
+    long        ttlMillis;
+    long        negativeTtlMillis;
+} cache;
+
+/**
+ * @brief counters summed over all shards.
+ */
+typedef struct cache_stats_s {
+    size_t hits;
+    size_t negativeHits;
+    size_t misses;
+    size_t expired;
+    size_t evictions;
+    size_t entries;
+} cache_stats;
+
+/**
+ * @brief initialize an empty cache.
+ *
+ * @param c pointer to the cache.
+ * @param entries most hostnames held, spread over the shards.
+ * @param ttlMillis lifetime of a resolved name.
+ * @param negativeTtlMillis lifetime of a name that did not resolve.
+ * @return int CACHE_SUCCESS on success, CACHE_FAILURE otherwise.
+ */
+int cache_init(cache* c, size_t entries, long ttlMillis, long negativeTtlMillis);
+
+/**
+ * @brief look a hostname up.
+ *
+ * @param c pointer to the cache.
+ * @param hostname the hostname.
+ * @param ip receives the cached address, empty on a negative hit.
+ * @param ipSize size of ip.
+ * @return int CACHE_HIT, CACHE_NEGATIVE_HIT or CACHE_MISS.
+ */
+int cache_get(cache* c, const char* hostname, char* ip, size_t ipSize);
+
+/**
+ * @brief store the result of a lookup, replacing what the cache held for
+ *          the name. A full shard evicts an entry to make room.
+ *
+ * @param c pointer to the cache.
+ * @param hostname the hostname, copied.
+ * @param ip its address, empty if the name did not resolve.
+ * @return int CACHE_SUCCESS on success, CACHE_FAILURE if the name could not
+ *          be copied.
+ */
+int cache_put(cache* c, const char* hostname, const char* ip);
+
+/**
+ * @brief sum the counters of all shards.
+ *
+ * @param c pointer to the cache.
+ * @param stats receives the sums.
+ */
+void cache_stats_get(cache* c, cache_stats* stats);
+
+/**
+ * @brief free every entry and the cache.
+ *
+ * @param c pointer to the cache.
+ */
+void cache_cleanup(cache* c);
+
+#endif /* CACHE_H */
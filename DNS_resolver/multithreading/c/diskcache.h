@@ -0,0 +1,136 @@
+/**
+ * @file diskcache.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for the persistent resolution cache. The cache is an
+ *          open-addressing hash table laid out directly in a file that
+ *          every run maps shared, so there is nothing to load or parse:
+ *          slots hold a hostname hash, its address and an expiry time.
+ *          Slots are guarded by per-slot sequence counters, so threads and
+ *          processes mapping the same file read and write it without locks.
+ * @version 0.1
+ * @date 2021-05-31
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DISKCACHE_FAILURE -1
+#define DISKCACHE_SUCCESS 0
+
+// diskcache_get() results
+#define DISKCACHE_MISS 0
+#define DISKCACHE_HIT 1
+#define DISKCACHE_NEGATIVE_HIT 2  // cached as not resolving
+
+#define DISKCACHE_MAGIC "DNSCACHE"
+#define DISKCACHE_VERSION 1
+#define DISKCACHE_HEADER_SIZE 4096  // slots start page aligned
+#define DISKCACHE_DEFAULT_SLOTS (256 * 1024)  // power of two
+#define DISKCACHE_PROBES 8  // slots looked at per hostname
+#define DISKCACHE_IP_WORDS 6  // INET6_ADDRSTRLEN rounded up to words
+#define DISKCACHE_DEFAULT_TTL (2 * 60 * 60)  // seconds, outlives an hourly rerun
+#define DISKCACHE_DEFAULT_NEGATIVE_TTL (10 * 60)
+// cache file, off unless the environment names one. Created readable by
+// its owner only, and never opened through a symlink or if someone else
+// owns it: answers in it are trusted.
+#define DISKCACHE_ENV "DNS_RESOLVER_CACHE"
+#define DISKCACHE_MODE 0600
+
+/**
+ * @brief file header, the slot table follows at DISKCACHE_HEADER_SIZE.
+ */
+typedef struct diskcache_header_s {
+    char     magic[8];
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotSize;
+} diskcache_header;
+
+/**
+ * @brief a slot of the table. A writer makes seq odd while it fills the
+ *          slot; readers retry or skip a slot whose seq moved under them.
+ */
+typedef struct diskcache_slot_s {
+    _Atomic uint32_t seq;
+    _Atomic uint32_t check;    // second hash of the hostname
+    _Atomic uint64_t hash;     // 0 if the slot was never used
+    _Atomic int64_t  expires;  // unix time, seconds
+    _Atomic uint64_t ip[DISKCACHE_IP_WORDS];  // address string, empty if the name did not resolve
+} diskcache_slot;
+
+/**
+ * @brief a mapped cache file. Counters are per process.
+ */
+typedef struct diskcache_s {
+    int             fd;
+    void*           map;
+    size_t          mapSize;
+    diskcache_slot* slots;
+    uint32_t        mask;
+    long            ttl;
+    long            negativeTtl;
+    atomic_size_t   hits;
+    atomic_size_t   negativeHits;
+    atomic_size_t   misses;
+    atomic_size_t   stores;
+    atomic_size_t   busy;  // stores dropped because another writer held the slot
+} diskcache;
+
+/**
+ * @brief map a cache file, creating it if it doesn't exist. An existing
+ *          file keeps its own slot count.
+ *
+ * @param c pointer to the cache.
+ * @param path the cache file.
+ * @param slots slot count of a new file, a power of two.
+ * @param ttl seconds a resolved name stays valid.
+ * @param negativeTtl seconds a name that did not resolve stays cached.
+ * @return int DISKCACHE_SUCCESS on success, DISKCACHE_FAILURE if the file
+ *          can't be opened, is a symlink, belongs to another user or isn't a
+ *          cache file.
+ */
+int diskcache_open(diskcache* c, const char* path, uint32_t slots, long ttl, long negativeTtl);
+
+/**
+ * @brief the cache file named by the environment.
+ *
+ * @return const char* the path, NULL if the cache is turned off.
+ */
+const char* diskcache_path();
+
+/**
+ * @brief look a hostname up.
+ *
+ * @param c pointer to the cache.
+ * @param hostname the hostname.
+ * @param ip receives the cached address, empty on a negative hit.
+ * @param ipSize size of ip.
+ * @return int DISKCACHE_HIT, DISKCACHE_NEGATIVE_HIT or DISKCACHE_MISS.
+ */
+int diskcache_get(diskcache* c, const char* hostname, char* ip, size_t ipSize);
+
+/**
+ * @brief store the result of a lookup. Best effort: the store is dropped
+ *          if another writer is filling the slot at the same time.
+ *
+ * @param c pointer to the cache.
+ * @param hostname the hostname.
+ * @param ip its address, empty if the name did not resolve.
+ */
+void diskcache_put(diskcache* c, const char* hostname, const char* ip);
+
+/**
+ * @brief unmap and close the cache file. Stores are already in the file.
+ *
+ * @param c pointer to the cache.
+ */
+void diskcache_close(diskcache* c);
+
+#endif /* DISKCACHE_H */
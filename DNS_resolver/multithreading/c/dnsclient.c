@@ -0,0 +1,682 @@
+/**
+ * @file dnsclient.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief non-blocking UDP DNS client driven by epoll.
+ * @version 0.1
+ * @date 2021-05-29
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "dnsclient.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DNS_HEADER_SIZE 12
+#define DNS_TYPE_A 1
+#define DNS_TYPE_AAAA 28
+#define DNS_CLASS_IN 1
+#define DNS_FLAG_QR 0x8000
+#define DNS_FLAG_RD 0x0100
+#define DNS_RCODE_MASK 0x000f
+#define DNS_MAX_LABEL 63
+#define DNSCLIENT_RCVBUF (4 * 1024 * 1024)
+
+static int64_t now_millis()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static uint16_t read16(const unsigned char* p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static void write16(unsigned char* p, uint16_t v)
+{
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+}
+
+// xorshift32, only used to spread query IDs
+static uint32_t next_random(dnsclient* c)
+{
+    c->rng ^= c->rng << 13;
+    c->rng ^= c->rng >> 17;
+    c->rng ^= c->rng << 5;
+
+    return c->rng;
+}
+
+// hostname to wire format: length-prefixed labels ending with the root
+static int encode_name(const char* hostname, unsigned char* out, size_t* length)
+{
+    const char* label = hostname;
+    size_t      n     = 0;
+
+    while (*label) {
+        const char* dot = strchr(label, '.');
+        size_t      len = dot ? (size_t)(dot - label) : strlen(label);
+
+        if (!len || len > DNS_MAX_LABEL || n + 1 + len + 1 > DNSCLIENT_MAX_QNAME) {
+            return DNSCLIENT_FAILURE;
+        }
+        out[n++] = (unsigned char)len;
+        memcpy(out + n, label, len);
+        n += len;
+        if (!dot) {
+            break;
+        }
+        // a trailing dot ends the name
+        label = dot + 1;
+    }
+    if (!n) {
+        return DNSCLIENT_FAILURE;
+    }
+    out[n++] = 0;
+    *length  = n;
+
+    return DNSCLIENT_SUCCESS;
+}
+
+// offset just past a possibly compressed name, 0 if it runs off the packet
+static size_t skip_name(const unsigned char* packet, size_t length, size_t pos)
+{
+    while (pos < length) {
+        unsigned char len = packet[pos];
+
+        if ((len & 0xc0) == 0xc0) {
+            // compression pointer ends the name
+            return pos + 2 <= length ? pos + 2 : 0;
+        }
+        if (!len) {
+            return pos + 1;
+        }
+        pos += 1 + len;
+    }
+
+    return 0;
+}
+
+static void heap_swap(dnsclient* c, int a, int b)
+{
+    int index = c->heap[a];
+
+    c->heap[a]                       = c->heap[b];
+    c->heap[b]                       = index;
+    c->queries[c->heap[a]].heapIndex = a;
+    c->queries[c->heap[b]].heapIndex = b;
+}
+
+static void heap_up(dnsclient* c, int pos)
+{
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+
+        if (c->queries[c->heap[parent]].wake <= c->queries[c->heap[pos]].wake) {
+            break;
+        }
+        heap_swap(c, pos, parent);
+        pos = parent;
+    }
+}
+
+static void heap_down(dnsclient* c, int pos)
+{
+    // the heap holds exactly the queries in flight
+    while (1) {
+        int child = 2 * pos + 1;
+
+        if (child >= c->inFlight) {
+            break;
+        }
+        if (child + 1 < c->inFlight && c->queries[c->heap[child + 1]].wake < c->queries[c->heap[child]].wake) {
+            child++;
+        }
+        if (c->queries[c->heap[pos]].wake <= c->queries[c->heap[child]].wake) {
+            break;
+        }
+        heap_swap(c, pos, child);
+        pos = child;
+    }
+}
+
+// the query's wake time changed, move it to its place
+static void schedule(dnsclient* c, int index)
+{
+    dnsclient_query* q = &c->queries[index];
+
+    q->wake = q->resend < q->expires ? q->resend : q->expires;
+    if (q->hedge && q->hedge < q->wake) {
+        q->wake = q->hedge;
+    }
+    heap_up(c, q->heapIndex);
+    heap_down(c, q->heapIndex);
+}
+
+// a free DNS ID, pointing at the query. There is one: at most two per
+// query are taken, see DNSCLIENT_MAX_IN_FLIGHT.
+static uint16_t take_id(dnsclient* c, int index)
+{
+    uint16_t id = (uint16_t)next_random(c);
+
+    while (c->ids[id] >= 0) {
+        id++;
+    }
+    c->ids[id] = index;
+
+    return id;
+}
+
+// forget the IDs of a query, late answers to them are stray
+static void drop_ids(dnsclient* c, dnsclient_query* q)
+{
+    c->ids[q->id] = -1;
+    if (q->hedgeLive) {
+        c->ids[q->hedgeId] = -1;
+        q->hedgeLive       = 0;
+    }
+}
+
+static void send_packet(dnsclient* c, dnsclient_query* q, uint16_t id)
+{
+    unsigned char packet[DNS_HEADER_SIZE + DNSCLIENT_MAX_QNAME + 4];
+
+    memset(packet, 0, DNS_HEADER_SIZE);
+    write16(packet, id);
+    write16(packet + 2, DNS_FLAG_RD);
+    write16(packet + 4, 1);  // one question
+    memcpy(packet + DNS_HEADER_SIZE, q->qname, q->qnameLength);
+    write16(packet + DNS_HEADER_SIZE + q->qnameLength, q->type);
+    write16(packet + DNS_HEADER_SIZE + q->qnameLength + 2, DNS_CLASS_IN);
+
+    // a full socket buffer is treated like a lost packet: the timeout
+    // sends it again
+    if (send(c->fd, packet, DNS_HEADER_SIZE + q->qnameLength + 4, 0) >= 0) {
+        c->sent++;
+    }
+}
+
+// (re)send a query under a fresh ID. Every try waits twice as long as the
+// one before, none past the deadline.
+static void send_query(dnsclient* c, int index)
+{
+    dnsclient_query* q       = &c->queries[index];
+    int64_t          timeout = c->timeoutMillis;
+
+    for (int i = 0; i < q->tries && timeout < DNSCLIENT_MAX_TIMEOUT; i++) {
+        timeout *= 2;
+    }
+    if (timeout > DNSCLIENT_MAX_TIMEOUT) {
+        timeout = DNSCLIENT_MAX_TIMEOUT;
+    }
+
+    q->id = take_id(c, index);
+    send_packet(c, q, q->id);
+    q->tries++;
+    q->sentAt = now_millis();
+    q->resend = q->sentAt + timeout;
+    // one duplicate per query, once this try is slower than most answers
+    q->hedge = 0;
+    if (c->hedging && c->hedgeMillis && !q->hedged &&
+        c->hedgesSent * 100 < c->submitted * DNSCLIENT_HEDGE_BUDGET) {
+        q->hedge = q->sentAt + c->hedgeMillis;
+    }
+    schedule(c, index);
+}
+
+static void send_hedge(dnsclient* c, int index)
+{
+    dnsclient_query* q = &c->queries[index];
+
+    if (c->hedgesSent * 100 >= c->submitted * DNSCLIENT_HEDGE_BUDGET) {
+        // others used the budget up since this one was scheduled
+        q->hedge = 0;
+        schedule(c, index);
+        return;
+    }
+    q->hedgeId = take_id(c, index);
+    send_packet(c, q, q->hedgeId);
+    q->hedged    = 1;
+    q->hedgeLive = 1;
+    q->hedge     = 0;
+    q->hedgedAt  = now_millis();
+    c->hedgesSent++;
+    schedule(c, index);
+}
+
+// an answer took this long, re-estimate the hedging delay now and then
+static void add_sample(dnsclient* c, int64_t millis)
+{
+    size_t rank;
+    size_t seen = 0;
+
+    if (!c->hedging) {
+        return;
+    }
+    if (millis >= DNSCLIENT_LATENCY_BUCKETS) {
+        millis = DNSCLIENT_LATENCY_BUCKETS - 1;
+    }
+    c->latency[millis < 0 ? 0 : millis]++;
+    c->samples++;
+    if (c->samples < DNSCLIENT_HEDGE_MIN_SAMPLES ||
+        (c->hedgeMillis && c->samples % DNSCLIENT_HEDGE_REFRESH)) {
+        return;
+    }
+
+    rank = c->samples * DNSCLIENT_HEDGE_PERCENTILE / 100;
+    for (int i = 0; i < DNSCLIENT_LATENCY_BUCKETS; i++) {
+        seen += c->latency[i];
+        if (seen > rank) {
+            // past the end of the bucket
+            c->hedgeMillis = i + 1;
+            break;
+        }
+    }
+}
+
+static void finish_query(dnsclient* c, int index, const char* ip)
+{
+    dnsclient_query* q       = &c->queries[index];
+    void*            context = q->context;
+    int              last    = c->heap[c->inFlight - 1];
+
+    // the last query of the heap takes this one's place
+    drop_ids(c, q);
+    c->inFlight--;
+    if (last != index) {
+        c->heap[q->heapIndex]      = last;
+        c->queries[last].heapIndex = q->heapIndex;
+        heap_up(c, q->heapIndex);
+        heap_down(c, c->queries[last].heapIndex);
+    }
+    q->next     = c->freeHead;
+    c->freeHead = index;
+    if (ip) {
+        c->answered++;
+    }
+    else {
+        c->failed++;
+    }
+
+    c->done(c->user, context, ip);
+}
+
+static void handle_response(dnsclient* c, const unsigned char* packet, size_t length)
+{
+    dnsclient_query* q;
+    uint16_t         id;
+    uint16_t         flags;
+    size_t           pos;
+    int              index;
+    int              answers;
+    int              byHedge;
+    char             ip[INET6_ADDRSTRLEN];
+
+    if (length < DNS_HEADER_SIZE) {
+        c->stray++;
+        return;
+    }
+    id    = read16(packet);
+    index = c->ids[id];
+    flags = read16(packet + 2);
+    if (index < 0 || !(flags & DNS_FLAG_QR) || read16(packet + 4) != 1) {
+        c->stray++;
+        return;
+    }
+
+    // the question must be ours, names compare case-insensitively
+    q   = &c->queries[index];
+    pos = DNS_HEADER_SIZE;
+    if (length < pos + q->qnameLength + 4) {
+        c->stray++;
+        return;
+    }
+    for (size_t i = 0; i < q->qnameLength; i++) {
+        if (tolower(packet[pos + i]) != tolower(q->qname[i])) {
+            c->stray++;
+            return;
+        }
+    }
+    pos += q->qnameLength;
+    if (read16(packet + pos) != q->type || read16(packet + pos + 2) != DNS_CLASS_IN) {
+        c->stray++;
+        return;
+    }
+    pos += 4;
+
+    // the server answered, whatever it said
+    byHedge = q->hedgeLive && id == q->hedgeId;
+    add_sample(c, now_millis() - (byHedge ? q->hedgedAt : q->sentAt));
+
+    if (flags & DNS_RCODE_MASK) {
+        // NXDOMAIN, SERVFAIL, REFUSED...
+        finish_query(c, index, NULL);
+        return;
+    }
+
+    // first record of the type we asked for, CNAMEs in front are skipped
+    answers = read16(packet + 6);
+    for (int i = 0; i < answers; i++) {
+        uint16_t type;
+        uint16_t rdLength;
+
+        pos = skip_name(packet, length, pos);
+        if (!pos || pos + 10 > length) {
+            break;
+        }
+        type     = read16(packet + pos);
+        rdLength = read16(packet + pos + 8);
+        pos += 10;
+        if (pos + rdLength > length) {
+            break;
+        }
+        if (read16(packet + pos - 8) == DNS_CLASS_IN &&
+            ((type == DNS_TYPE_A && q->type == DNS_TYPE_A && rdLength == 4) ||
+             (type == DNS_TYPE_AAAA && q->type == DNS_TYPE_AAAA && rdLength == 16))) {
+            inet_ntop(type == DNS_TYPE_A ? AF_INET : AF_INET6, packet + pos, ip, sizeof(ip));
+            if (byHedge) {
+                c->hedgeWins++;
+            }
+            else if (q->tries > 1) {
+                c->recovered++;
+            }
+            finish_query(c, index, ip);
+            return;
+        }
+        pos += rdLength;
+    }
+
+    if (q->type == DNS_TYPE_A) {
+        // no IPv4 address, try IPv6 before giving up, within the same
+        // deadline
+        drop_ids(c, q);
+        q->type   = DNS_TYPE_AAAA;
+        q->tries  = 0;
+        q->hedged = 0;
+        send_query(c, index);
+        return;
+    }
+    finish_query(c, index, NULL);
+}
+
+// run the timers that are due
+static void expire_queries(dnsclient* c)
+{
+    int64_t now = now_millis();
+
+    while (c->inFlight && c->queries[c->heap[0]].wake <= now) {
+        int              index = c->heap[0];
+        dnsclient_query* q     = &c->queries[index];
+
+        if (q->expires <= now || (q->resend <= now && q->tries > c->retries)) {
+            c->timedOut++;
+            finish_query(c, index, NULL);
+        }
+        else if (q->resend <= now) {
+            // lost, or the server is slow: send again under a new ID so a
+            // late answer to the old one is ignored
+            drop_ids(c, q);
+            c->retried++;
+            send_query(c, index);
+        }
+        else {
+            send_hedge(c, index);
+        }
+    }
+}
+
+int dnsclient_parse_server(const char* str, struct sockaddr_storage* server, socklen_t* length)
+{
+    char                 address[INET6_ADDRSTRLEN + 8];
+    char*                port = NULL;
+    struct sockaddr_in*  v4   = (struct sockaddr_in*)server;
+    struct sockaddr_in6* v6   = (struct sockaddr_in6*)server;
+
+    if (!str) {
+        // first nameserver the system resolver would use
+        FILE* conf = fopen(DNSCLIENT_RESOLV_CONF, "r");
+        char  line[256];
+
+        address[0] = '\0';
+        while (conf && fgets(line, sizeof(line), conf)) {
+            if (sscanf(line, "nameserver %45s", address) == 1) {
+                break;
+            }
+        }
+        if (conf) {
+            fclose(conf);
+        }
+        if (!address[0]) {
+            return DNSCLIENT_FAILURE;
+        }
+    }
+    else if (str[0] == '[') {
+        // [addr6]:port
+        const char* end = strchr(str, ']');
+        if (!end || (size_t)(end - str - 1) >= sizeof(address)) {
+            return DNSCLIENT_FAILURE;
+        }
+        memcpy(address, str + 1, end - str - 1);
+        address[end - str - 1] = '\0';
+        if (end[1] == ':') {
+            port = (char*)end + 2;
+        }
+    }
+    else {
+        snprintf(address, sizeof(address), "%s", str);
+        // a single colon separates an IPv4 address from its port
+        port = strchr(address, ':');
+        if (port && strchr(port + 1, ':')) {
+            port = NULL;
+        }
+        else if (port) {
+            *port++ = '\0';
+        }
+    }
+
+    memset(server, 0, sizeof(*server));
+    if (inet_pton(AF_INET, address, &v4->sin_addr) == 1) {
+        v4->sin_family = AF_INET;
+        v4->sin_port   = htons(port ? atoi(port) : DNSCLIENT_DEFAULT_PORT);
+        *length        = sizeof(*v4);
+    }
+    else if (inet_pton(AF_INET6, address, &v6->sin6_addr) == 1) {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port   = htons(port ? atoi(port) : DNSCLIENT_DEFAULT_PORT);
+        *length         = sizeof(*v6);
+    }
+    else {
+        return DNSCLIENT_FAILURE;
+    }
+
+    return DNSCLIENT_SUCCESS;
+}
+
+int dnsclient_init(dnsclient*                     c,
+                   const struct sockaddr_storage* server,
+                   socklen_t                      length,
+                   int                            capacity,
+                   int                            timeoutMillis,
+                   int                            retries,
+                   int                            deadlineMillis,
+                   int                            hedging,
+                   dnsclient_done                 done,
+                   void*                          user)
+{
+    struct epoll_event event;
+    int                rcvbuf = DNSCLIENT_RCVBUF;
+    int                span   = 1;
+
+    memset(c, 0, sizeof(*c));
+    c->fd             = -1;
+    c->epfd           = -1;
+    c->capacity       = capacity < 1 ? 1 : capacity > DNSCLIENT_MAX_IN_FLIGHT ? DNSCLIENT_MAX_IN_FLIGHT : capacity;
+    c->timeoutMillis  = timeoutMillis;
+    c->retries        = retries;
+    c->deadlineMillis = deadlineMillis;
+    c->hedging        = hedging;
+    c->done           = done;
+    c->user           = user;
+    c->server         = *server;
+    c->serverLength   = length;
+    c->rng            = (uint32_t)now_millis() ^ (uint32_t)(uintptr_t)c;
+    if (!c->rng) {
+        c->rng = 1;
+    }
+    // each try waits twice as long as the one before, 1 + 2 + 4... first
+    // timeouts in all, which have to fit in the deadline
+    for (int i = 0; i < retries && span < deadlineMillis; i++) {
+        span = 2 * span + 1;
+    }
+    if ((int64_t)c->timeoutMillis * span > deadlineMillis) {
+        c->timeoutMillis = deadlineMillis / span ? deadlineMillis / span : 1;
+    }
+
+    c->queries = malloc(sizeof(dnsclient_query) * c->capacity);
+    c->heap    = malloc(sizeof(int) * c->capacity);
+    c->ids     = malloc(sizeof(int32_t) * DNSCLIENT_IDS);
+    c->latency = calloc(DNSCLIENT_LATENCY_BUCKETS, sizeof(uint32_t));
+    if (!c->queries || !c->heap || !c->ids || !c->latency) {
+        perror("Error on DNS client Malloc");
+        dnsclient_cleanup(c);
+        return DNSCLIENT_FAILURE;
+    }
+    for (int i = 0; i < DNSCLIENT_IDS; i++) {
+        c->ids[i] = -1;
+    }
+    for (int i = 0; i < c->capacity; i++) {
+        c->queries[i].next = i + 1 < c->capacity ? i + 1 : -1;
+    }
+    c->freeHead = 0;
+
+    // connected: the kernel drops datagrams from anyone but the server
+    c->fd = socket(server->ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (c->fd < 0 || connect(c->fd, (const struct sockaddr*)server, length) < 0) {
+        perror("Error opening DNS socket");
+        dnsclient_cleanup(c);
+        return DNSCLIENT_FAILURE;
+    }
+    // room for a burst of answers to thousands of queries
+    setsockopt(c->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    c->epfd = epoll_create1(EPOLL_CLOEXEC);
+    memset(&event, 0, sizeof(event));
+    event.events  = EPOLLIN;
+    event.data.fd = c->fd;
+    if (c->epfd < 0 || epoll_ctl(c->epfd, EPOLL_CTL_ADD, c->fd, &event) < 0) {
+        perror("Error setting up epoll");
+        dnsclient_cleanup(c);
+        return DNSCLIENT_FAILURE;
+    }
+
+    return DNSCLIENT_SUCCESS;
+}
+
+int dnsclient_submit(dnsclient* c, const char* hostname, void* context)
+{
+    dnsclient_query* q;
+    int              index = c->freeHead;
+
+    if (index < 0) {
+        return DNSCLIENT_FAILURE;
+    }
+    q = &c->queries[index];
+    if (encode_name(hostname, q->qname, &q->qnameLength) == DNSCLIENT_FAILURE) {
+        return DNSCLIENT_FAILURE;
+    }
+    c->freeHead  = q->next;
+    q->context   = context;
+    q->type      = DNS_TYPE_A;
+    q->tries     = 0;
+    q->hedged    = 0;
+    q->hedgeLive = 0;
+    q->expires   = now_millis() + c->deadlineMillis;
+    c->submitted++;
+    // at the end of the heap, send_query() moves it up
+    q->heapIndex           = c->inFlight;
+    c->heap[c->inFlight++] = index;
+    if (c->inFlight > c->peakInFlight) {
+        c->peakInFlight = c->inFlight;
+    }
+    send_query(c, index);
+
+    return DNSCLIENT_SUCCESS;
+}
+
+int dnsclient_poll(dnsclient* c, int timeoutMillis)
+{
+    struct epoll_event event;
+    unsigned char      packet[DNSCLIENT_MAX_PACKET];
+    size_t             before = c->answered + c->failed;
+    int                wait   = timeoutMillis;
+
+    // don't sleep past the next timer
+    if (c->inFlight) {
+        int64_t until = c->queries[c->heap[0]].wake - now_millis();
+        if (until < 0) {
+            until = 0;
+        }
+        if (wait < 0 || until < wait) {
+            wait = (int)until;
+        }
+    }
+
+    if (epoll_wait(c->epfd, &event, 1, wait) > 0) {
+        // drain everything that arrived
+        while (1) {
+            ssize_t rc = recv(c->fd, packet, sizeof(packet), 0);
+            if (rc < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // EAGAIN, or an ICMP error for the server reported here
+                break;
+            }
+            handle_response(c, packet, (size_t)rc);
+        }
+    }
+    expire_queries(c);
+
+    return (int)(c->answered + c->failed - before);
+}
+
+int dnsclient_in_flight(const dnsclient* c)
+{
+    return c->inFlight;
+}
+
+void dnsclient_cleanup(dnsclient* c)
+{
+    if (c->epfd >= 0) {
+        close(c->epfd);
+    }
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+    free(c->queries);
+    free(c->heap);
+    free(c->ids);
+    free(c->latency);
+    c->queries = NULL;
+    c->heap    = NULL;
+    c->ids     = NULL;
+    c->latency = NULL;
+    c->fd      = -1;
+    c->epfd    = -1;
+}
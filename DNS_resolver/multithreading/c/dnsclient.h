@@ -0,0 +1,195 @@
+/**
+ * @file dnsclient.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for a non-blocking UDP DNS client. It builds A and
+ *          AAAA queries itself, keeps thousands of them in flight on one
+ *          socket driven by epoll, and matches responses to queries by ID.
+ *          Every query has a deadline; within it lost queries are sent
+ *          again with a growing timeout, and one that takes longer than
+ *          most answers do can be hedged with a duplicate, the first
+ *          answer to either wins.
+ * @version 0.1
+ * @date 2021-05-29
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef DNSCLIENT_H
+#define DNSCLIENT_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define DNSCLIENT_FAILURE -1
+#define DNSCLIENT_SUCCESS 0
+
+#define DNSCLIENT_IDS 65536  // the DNS ID space
+// a query holds two IDs at most, its own and its duplicate's, so there is
+// always a free one to take
+#define DNSCLIENT_MAX_IN_FLIGHT (DNSCLIENT_IDS / 2)
+#define DNSCLIENT_DEFAULT_IN_FLIGHT 1024
+#define DNSCLIENT_DEFAULT_TIMEOUT 1000  // milliseconds, first try
+#define DNSCLIENT_MAX_TIMEOUT 8000  // the timeout doubles every try up to this
+#define DNSCLIENT_DEFAULT_RETRIES 2
+#define DNSCLIENT_DEFAULT_DEADLINE 5000  // milliseconds a query may take in all
+#define DNSCLIENT_HEDGE_PERCENTILE 95  // hedge queries slower than this share of answers
+#define DNSCLIENT_HEDGE_MIN_SAMPLES 100  // answers seen before hedging starts
+#define DNSCLIENT_HEDGE_REFRESH 256  // answers between estimates
+#define DNSCLIENT_HEDGE_BUDGET 10  // duplicates per 100 queries at most, a slow server isn't swamped
+#define DNSCLIENT_LATENCY_BUCKETS 2048  // one per millisecond, the last one open ended
+#define DNSCLIENT_DEFAULT_PORT 53
+#define DNSCLIENT_MAX_QNAME 255  // wire format, RFC 1035 2.3.4
+#define DNSCLIENT_MAX_PACKET 4096
+#define DNSCLIENT_RESOLV_CONF "/etc/resolv.conf"
+
+/**
+ * @brief called once per submitted hostname.
+ *
+ * @param user the user pointer given to dnsclient_init().
+ * @param context the context given to dnsclient_submit().
+ * @param ip the first address found, NULL if the name did not resolve.
+ */
+typedef void (*dnsclient_done)(void* user, void* context, const char* ip);
+
+/**
+ * @brief an outstanding query. Queries wait in a heap ordered by the next
+ *          thing due for them, free ones on a free list. Times are in
+ *          milliseconds, CLOCK_MONOTONIC.
+ */
+typedef struct dnsclient_query_s {
+    void*         context;
+    int64_t       expires;  // deadline, fails after this
+    int64_t       resend;   // this try times out
+    int64_t       hedge;    // send the duplicate, 0 if none is due
+    int64_t       sentAt;   // this try was sent
+    int64_t       hedgedAt;
+    int64_t       wake;     // earliest of the above, the heap key
+    uint16_t      id;       // this try
+    uint16_t      hedgeId;  // the duplicate, if hedged
+    uint16_t      type;     // A, or AAAA once A came back empty
+    uint8_t       hedged;   // the query got its duplicate
+    uint8_t       hedgeLive;  // ... and hedgeId is still listened to
+    int           tries;
+    int           heapIndex;
+    int           next;  // free list, -1 terminated
+    size_t        qnameLength;
+    unsigned char qname[DNSCLIENT_MAX_QNAME];
+} dnsclient_query;
+
+/**
+ * @brief a client, used by one thread.
+ */
+typedef struct dnsclient_s {
+    int                     fd;
+    int                     epfd;
+    struct sockaddr_storage server;
+    socklen_t               serverLength;
+    dnsclient_query*        queries;
+    int                     capacity;
+    int                     inFlight;
+    int                     freeHead;
+    int*                    heap;  // query indices, soonest wake first
+    int32_t*                ids;   // DNS ID to query index, -1 if unused
+    uint32_t                rng;
+    int                     timeoutMillis;
+    int                     retries;
+    int                     deadlineMillis;
+    int                     hedging;
+    int                     hedgeMillis;  // current estimate, 0 until there are enough answers
+    uint32_t*               latency;      // answer times, DNSCLIENT_LATENCY_BUCKETS
+    size_t                  samples;
+    dnsclient_done          done;
+    void*                   user;
+    size_t                  submitted;
+    size_t                  sent;  // packets sent, retries and duplicates included
+    size_t                  retried;
+    size_t                  hedgesSent;
+    // outcomes, one per submitted query
+    size_t                  answered;   // all resolved ones, the next two included
+    size_t                  recovered;  // resolved after a retry
+    size_t                  hedgeWins;  // resolved by the duplicate
+    size_t                  failed;     // NXDOMAIN, SERVFAIL, no address... and the timed out ones
+    size_t                  timedOut;   // deadline passed or retries used up
+    size_t                  stray;      // responses no query was waiting for
+    int                     peakInFlight;
+} dnsclient;
+
+/**
+ * @brief parse a nameserver address, "addr", "addr:port" or "[addr6]:port".
+ *          NULL reads the first nameserver of /etc/resolv.conf.
+ *
+ * @param str the address.
+ * @param server receives the socket address.
+ * @param length receives its length.
+ * @return int DNSCLIENT_SUCCESS on success, DNSCLIENT_FAILURE otherwise.
+ */
+int dnsclient_parse_server(const char* str, struct sockaddr_storage* server, socklen_t* length);
+
+/**
+ * @brief open a client socket towards a nameserver.
+ *
+ * @param c pointer to the client.
+ * @param server nameserver address, see dnsclient_parse_server().
+ * @param length its length.
+ * @param capacity most queries in flight, up to DNSCLIENT_MAX_IN_FLIGHT.
+ * @param timeoutMillis time to wait for the first answer before sending
+ *          again, doubled on every retry. Shortened so that every retry
+ *          fits in the deadline.
+ * @param retries times to send again before giving up.
+ * @param deadlineMillis time a query may take in all, retries included.
+ * @param hedging non-zero to send a duplicate of queries that take longer than
+ *          DNSCLIENT_HEDGE_PERCENTILE percent of the answers did.
+ * @param done called for every finished query.
+ * @param user passed to done.
+ * @return int DNSCLIENT_SUCCESS on success, DNSCLIENT_FAILURE otherwise.
+ */
+int dnsclient_init(dnsclient*                     c,
+                   const struct sockaddr_storage* server,
+                   socklen_t                      length,
+                   int                            capacity,
+                   int                            timeoutMillis,
+                   int                            retries,
+                   int                            deadlineMillis,
+                   int                            hedging,
+                   dnsclient_done                 done,
+                   void*                          user);
+
+/**
+ * @brief send an A query for a hostname, without waiting for the answer.
+ *
+ * @param c pointer to the client.
+ * @param hostname the hostname, copied into the query.
+ * @param context passed to done.
+ * @return int DNSCLIENT_SUCCESS if the query is in flight, DNSCLIENT_FAILURE
+ *          if the client is full or the name can't be put in a query.
+ */
+int dnsclient_submit(dnsclient* c, const char* hostname, void* context);
+
+/**
+ * @brief wait for answers and timers, calling done for every query that
+ *          finished.
+ *
+ * @param c pointer to the client.
+ * @param timeoutMillis longest time to wait, 0 to only take what is there.
+ * @return int number of queries finished.
+ */
+int dnsclient_poll(dnsclient* c, int timeoutMillis);
+
+/**
+ * @brief number of queries in flight.
+ *
+ * @param c pointer to the client.
+ * @return int the number of queries.
+ */
+int dnsclient_in_flight(const dnsclient* c);
+
+/**
+ * @brief close the client. Queries still in flight are dropped without
+ *          calling done.
+ *
+ * @param c pointer to the client.
+ */
+void dnsclient_cleanup(dnsclient* c);
+
+#endif /* DNSCLIENT_H */
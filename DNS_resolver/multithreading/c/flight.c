@@ -0,0 +1,143 @@
+/**
+ * @file flight.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief single-flight coalescing of concurrent lookups of a hostname.
+ * @version 0.1
+ * @date 2021-05-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "flight.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t hash_name(const char* hostname)
+{
+    uint64_t h = FNV_OFFSET;
+
+    for (const unsigned char* p = (const unsigned char*)hostname; *p; p++) {
+        h ^= *p;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static flight_shard* shard_of(flight_table* t, uint64_t hash)
+{
+    return &t->shards[hash >> 58 & (FLIGHT_SHARDS - 1)];
+}
+
+void flight_init(flight_table* t)
+{
+    memset(t, 0, sizeof(*t));
+    for (int i = 0; i < FLIGHT_SHARDS; i++) {
+        pthread_mutex_init(&t->shards[i].lock, NULL);
+    }
+}
+
+int flight_join(flight_table* t, char* hostname)
+{
+    uint64_t      hash   = hash_name(hostname);
+    flight_shard* s      = shard_of(t, hash);
+    flight**      bucket = &s->buckets[hash & (FLIGHT_BUCKETS - 1)];
+    flight*       f;
+
+    pthread_mutex_lock(&s->lock);
+    for (f = *bucket; f; f = f->next) {
+        if (f->hash == hash && !strcmp(f->hostname, hostname)) {
+            flight_waiter* w = malloc(sizeof(flight_waiter));
+
+            if (!w) {
+                // look it up a second time rather than lose it
+                break;
+            }
+            w->hostname = hostname;
+            w->next     = f->waiters;
+            f->waiters  = w;
+            s->coalesced++;
+            pthread_mutex_unlock(&s->lock);
+            return FLIGHT_JOINED;
+        }
+    }
+
+    s->leads++;
+    f = malloc(sizeof(flight));
+    if (!f) {
+        pthread_mutex_unlock(&s->lock);
+        perror("Error on flight Malloc");
+        return FLIGHT_LEAD;
+    }
+    f->hash     = hash;
+    f->hostname = hostname;
+    f->waiters  = NULL;
+    f->next     = *bucket;
+    *bucket     = f;
+    pthread_mutex_unlock(&s->lock);
+
+    return FLIGHT_LEAD;
+}
+
+flight_waiter* flight_finish(flight_table* t, const char* hostname)
+{
+    uint64_t       hash    = hash_name(hostname);
+    flight_shard*  s       = shard_of(t, hash);
+    flight_waiter* waiters = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    // the leader's copy, not the name: a leader that wasn't recorded must
+    // not end someone else's lookup
+    for (flight** link = &s->buckets[hash & (FLIGHT_BUCKETS - 1)]; *link; link = &(*link)->next) {
+        if ((*link)->hostname == hostname) {
+            flight* f = *link;
+
+            *link   = f->next;
+            waiters = f->waiters;
+            free(f);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    return waiters;
+}
+
+char* flight_next(flight_waiter** waiters)
+{
+    flight_waiter* w = *waiters;
+    char*          hostname;
+
+    if (!w) {
+        return NULL;
+    }
+    hostname = w->hostname;
+    *waiters = w->next;
+    free(w);
+
+    return hostname;
+}
+
+void flight_stats(flight_table* t, size_t* leads, size_t* coalesced)
+{
+    *leads     = 0;
+    *coalesced = 0;
+    for (int i = 0; i < FLIGHT_SHARDS; i++) {
+        pthread_mutex_lock(&t->shards[i].lock);
+        *leads += t->shards[i].leads;
+        *coalesced += t->shards[i].coalesced;
+        pthread_mutex_unlock(&t->shards[i].lock);
+    }
+}
+
+void flight_cleanup(flight_table* t)
+{
+    for (int i = 0; i < FLIGHT_SHARDS; i++) {
+        pthread_mutex_destroy(&t->shards[i].lock);
+    }
+}
@@ -0,0 +1,122 @@
+/**
+ * @file flight.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for single-flight coalescing of lookups. The first
+ *          resolver to ask for a hostname leads its lookup; resolvers
+ *          popping the same name while it runs leave their copy with the
+ *          leader and move on, and the leader writes a line for every copy
+ *          once the answer is in. Nobody sleeps on someone else's lookup,
+ *          so it works the same for the blocking and the asynchronous
+ *          backends.
+ * @version 0.1
+ * @date 2021-05-30
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLIGHT_FAILURE -1
+#define FLIGHT_SUCCESS 0
+
+// flight_join() results
+#define FLIGHT_LEAD 0    // look the name up, then call flight_finish()
+#define FLIGHT_JOINED 1  // the leader writes this copy's line
+
+#define FLIGHT_SHARDS 64  // power of two
+#define FLIGHT_BUCKETS 256  // per shard, power of two
+#define FLIGHT_LINE_SIZE 64
+
+/**
+ * @brief a copy of a hostname waiting on another resolver's lookup.
+ */
+typedef struct flight_waiter_s {
+    char*                   hostname;
+    struct flight_waiter_s* next;
+} flight_waiter;
+
+/**
+ * @brief a lookup in progress.
+ */
+typedef struct flight_s {
+    uint64_t         hash;
+    const char*      hostname;  // the leader's copy, identifies the lookup
+    flight_waiter*   waiters;
+    struct flight_s* next;
+} flight;
+
+/**
+ * @brief one lock stripe of the table, on its own cache line.
+ */
+typedef struct flight_shard_s {
+    _Alignas(FLIGHT_LINE_SIZE) pthread_mutex_t lock;
+    flight* buckets[FLIGHT_BUCKETS];
+    size_t  leads;      // lookups started
+    size_t  coalesced;  // copies that joined one instead
+} flight_shard;
+
+/**
+ * @brief the lookups in flight, shared by the resolvers.
+ */
+typedef struct flight_table_s {
+    flight_shard shards[FLIGHT_SHARDS];
+} flight_table;
+
+/**
+ * @brief initialize an empty table.
+ *
+ * @param t pointer to the table.
+ */
+void flight_init(flight_table* t);
+
+/**
+ * @brief join the lookup of hostname if one is running, or start one.
+ *
+ * @param t pointer to the table.
+ * @param hostname the hostname. A joined copy is handed over to the leader.
+ * @return int FLIGHT_JOINED or FLIGHT_LEAD. A leader that could not be
+ *          recorded still leads, nobody joins it.
+ */
+int flight_join(flight_table* t, char* hostname);
+
+/**
+ * @brief end a lookup started with flight_join().
+ *
+ * @param t pointer to the table.
+ * @param hostname the leader's copy, the one passed to flight_join().
+ * @return flight_waiter* copies that joined the lookup, take them with
+ *          flight_next().
+ */
+flight_waiter* flight_finish(flight_table* t, const char* hostname);
+
+/**
+ * @brief take the next copy off a waiter list.
+ *
+ * @param waiters the list, advanced by one.
+ * @return char* the hostname, NULL at the end of the list.
+ */
+char* flight_next(flight_waiter** waiters);
+
+/**
+ * @brief sum the counters of all shards.
+ *
+ * @param t pointer to the table.
+ * @param leads receives the number of lookups started.
+ * @param coalesced receives the number of copies that joined one.
+ */
+void flight_stats(flight_table* t, size_t* leads, size_t* coalesced);
+
+/**
+ * @brief free the table, no lookup may be in flight.
+ *
+ * @param t pointer to the table.
+ */
+void flight_cleanup(flight_table* t);
+
+#endif /* FLIGHT_H */
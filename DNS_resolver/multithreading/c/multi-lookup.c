@@ -12,32 +12,68 @@
 #include "multi-lookup.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "cache.h"
+#include "diskcache.h"
+#include "dnsclient.h"
+#include "flight.h"
+#include "outbuf.h"
+#include "reader.h"
+#include "reorder.h"
+#ifdef USE_LOCKFREE_RING
+#include "ring.h"
+#else
 #include "queue.h"
+#endif
 #include "util.h"
+#include "writer.h"
 
 #define TRUE 1U
 #define FALSE 0U
-#define USLEEP 50U  // between 1 and 100, in microseconds
 #define MINARGS 3
-#define QUEUE_BOUND 5U
+#define QUEUE_BOUND 5
 #define EMPTY_STRING ""
-#define INPUTFS "%1024s"
-#define MAX_INPUT_FILES 10
 #define MAX_NAME_LENGTH 1025U
 #define MIN_RESOLVER_THREADS 2
 #define MIN_REQUESTER_THREADS 1
 #define MAX_RESOLVER_THREADS 10
-#define MAX_REQUESTER_THREADS MAX_INPUT_FILES
+#define MAX_REQUESTER_THREADS 64
 #define RESOLVER_THREADS_COUNT MAX_RESOLVER_THREADS
-#define REQUESTER_THREADS_COUNT MAX_REQUESTER_THREADS
+#define REQUESTER_THREADS_COUNT 10
 #define MAX_IP_LENGTH INET6_ADDRSTRLEN
-#define USAGE "<inputFilePath> <outputFilePath>"
+#define MAX_IPS_LENGTH (UTIL_MAX_ADDRESSES * INET6_ADDRSTRLEN)  // every address, comma separated
+#define DEFAULT_BATCH_SIZE 1
+#define MAX_BATCH_SIZE 4096
+#define DEFAULT_FLUSH_BYTES (64 * 1024)
+#define DEFAULT_FLUSH_MILLIS 1000
+#define DEFAULT_WINDOW_BYTES (4 * 1024 * 1024)
+#define ASYNC_RESOLVER_THREADS 2  // each keeps inFlight lookups going
+#define ASYNC_SUBMIT_BATCH 256
+#define ASYNC_IDLE_POLL_MILLIS 10
+#define GAI_DEFAULT_IN_FLIGHT 64  // glibc runs at most 20 of them at once
+#define BACKEND_GETADDRINFO 0
+#define BACKEND_UDP 1
+#define BACKEND_GAI_A 2
+#define OPTSTRING "b:c:i:n:oq:r:s:t:w:AB:D:F:HN:R:ST:W:"
+#define USAGE                                                                   \
+    "[-b batchSize] [-q queueBound] [-r requesterThreads] [-s splitBytes[k|m|g]] " \
+    "[-F flushBytes[k|m]] [-T flushMillis] [-W uring|writev] "                    \
+    "[-o [-w windowBytes[k|m]]] "                                                 \
+    "[-c cacheEntries[k|m]] [-t ttlSeconds] [-N negativeTtlSeconds] [-S] "      \
+    "[-B getaddrinfo|synthetic[:options]|null[:address]|gai_a|udp "             \
+    "[-n nameserver[:port]] [-i inFlightPerThread]] "                            \
+    "[-D deadlineMillis] [-R retries] [-H] "                                     \
+    "[-A] "                                                                      \
+    "<inputFilePath> <outputFilePath>"
 
 // internal error codes -- alter: make it an enum
 #define ERROR_GENERIC -1  // unused
@@ -49,15 +85,104 @@
 #define ERROR_DEINIT -7
 #define ERROR_THREAD_CREATION -8
 #define ERROR_THREAD_JOINING -9
-#define ERROR_TOO_MANY_INPUT_FILES -10
+
+/**
+ * @brief a lookup queued with getaddrinfo_a().
+ */
+typedef struct gai_slot_s {
+    struct gaicb request;  // ar_name points at hostname
+    char*        hostname;
+} gai_slot;
+
+/**
+ * @brief getaddrinfo_a() completion notification of one resolver. glibc
+ *          calls gai_notify() from a thread of its own once every lookup
+ *          of a submission is done.
+ */
+typedef struct gai_notifier_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  finished;
+    int             batches;   // submissions not notified yet
+    size_t          notified;  // submissions notified so far
+} gai_notifier;
+
+/**
+ * @brief an input file taken off the file list by a requester. It stays
+ *          mapped until the last of its chunks is read.
+ */
+typedef struct input_file_s {
+    const char*     path;
+    input_map       map;
+    atomic_int      pending;  // chunks not fully read yet
+    atomic_size_t   names;    // hostnames read so far
+    struct timespec opened;
+} input_file;
+
+/**
+ * @brief a byte range of one input file, the unit of work of a requester.
+ *          Ranges start and end on line boundaries.
+ */
+typedef struct input_chunk_s {
+    input_file*           file;
+    uint64_t              id;  // REORDER_CHUNK(file, chunk), its input order
+    size_t                begin;
+    size_t                end;
+    struct input_chunk_s* next;
+} input_chunk;
 
 // Global static variables
+#ifdef USE_LOCKFREE_RING
+static ring            myQ;
+static pthread_mutex_t myQWaitLock;  // only taken when a thread has to sleep
+static atomic_int      myQNotFullWaiters  = 0;
+static atomic_int      myQNotEmptyWaiters = 0;
+static atomic_int      stillRequesting    = TRUE;
+#else
 static queue           myQ;
 static pthread_mutex_t myQLock;
-static pthread_mutex_t outputFileLock;
-static FILE*           outputfp           = NULL;  //Holds the output file
-static int             stillRequesting    = TRUE;
+static int             stillRequesting    = TRUE;  // guarded by myQLock
+#endif
+static pthread_cond_t  myQNotFull;
+static pthread_cond_t  myQNotEmpty;
+static int             outputfd           = -1;  //Holds the output file
+static writer          outputWriter;  // the only thread writing to outputfd
+static int             writerFlags        = 0;
+static int             ordered            = FALSE;  // write lines in input order
+static reorder         outputOrder;  // reorder window in front of the writer
+static size_t          windowBytes        = DEFAULT_WINDOW_BYTES;
+static int             backend            = BACKEND_GETADDRINFO;
+static const char*     backendSpec        = NULL;  // NULL: from UTIL_BACKEND_ENV
+static const dnsbackend* resolver         = NULL;  // what the blocking resolvers call
+static int             resolverCount      = RESOLVER_THREADS_COUNT;
+static const char*     nameserverAddress  = NULL;  // NULL: from /etc/resolv.conf
+static struct sockaddr_storage nameserver;
+static socklen_t       nameserverLength   = 0;
+static int             inFlight           = 0;  // per thread, 0: the backend's default
+static int             deadlineMillis     = DNSCLIENT_DEFAULT_DEADLINE;  // per query, udp backend
+static int             retries            = DNSCLIENT_DEFAULT_RETRIES;
+static int             hedging            = FALSE;
+static int             allAddresses       = FALSE;  // every A and AAAA address, not the first one
+static atomic_size_t   resolvedCount      = 0;
+static cache           resultCache;  // shared by the resolvers, in front of every backend
+static size_t          cacheEntries       = CACHE_DEFAULT_ENTRIES;  // 0: no cache
+static long            cacheTtl           = CACHE_DEFAULT_TTL;
+static long            negativeTtl        = CACHE_DEFAULT_NEGATIVE_TTL;
+static diskcache       resultFile;  // results of earlier runs, mapped from disk
+static int             diskCaching        = FALSE;
+static flight_table    inFlightNames;  // lookups running, duplicates join them
+static int             coalescing         = TRUE;
+static size_t          flushBytes         = DEFAULT_FLUSH_BYTES;
+static long            flushMillis        = DEFAULT_FLUSH_MILLIS;
+static int             batchSize          = DEFAULT_BATCH_SIZE;
+static int             queueBound         = QUEUE_BOUND;
 static int             numberOfInputFiles = 0;
+static char**          inputPaths         = NULL;
+static pthread_mutex_t workLock;  // guards the work list and nextInputFile
+static input_chunk*    workHead           = NULL;  // chunks of opened files
+static input_chunk*    workTail           = NULL;
+static int             nextInputFile      = 0;  // next path to open
+static size_t          splitBytes         = 0;  // 0: one chunk per input file
+static int             requesterCount     = 0;  // 0: pick from the input
 
 void error_handler(int error, char* str)
 {
@@ -122,13 +247,6 @@ void error_handler(int error, char* str)
             error_code           = -99;  // todo: add respective error code
             break;
 
-        case ERROR_TOO_MANY_INPUT_FILES:
-            // failed due to too many input files
-            fprintf(stderr, "Too many input files. [MAX=%d]\n", MAX_INPUT_FILES);
-            error_is_recoverable = FALSE;
-            error_code           = -99;  // todo: add respective error code
-            break;
-
         default:
             break;
     }
@@ -139,123 +257,864 @@ void error_handler(int error, char* str)
     }
 }
 
-void* request(void* inputFile)
+#ifdef USE_LOCKFREE_RING
+/* wake threads sleeping on cond, if any. The fence pairs with the one in
+ * the sleeper so either it sees our ring update or we see it waiting. */
+static void hostq_wake(pthread_cond_t* cond, atomic_int* waiters, int count)
 {
-    char  hostname[MAX_NAME_LENGTH];  //Holds the individual hostname
-    char* hostname_temp;
-    FILE* inputfp = fopen((char*)inputFile, "r");
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiters, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&myQWaitLock);
+        if (count > 1) {
+            pthread_cond_broadcast(cond);
+        }
+        else {
+            pthread_cond_signal(cond);
+        }
+        pthread_mutex_unlock(&myQWaitLock);
+    }
+}
+#endif
 
-    // check input file stream
-    if (!inputfp) {
-        error_handler(ERROR_BOGUS_INPUT_FILE_PATH, (char*)inputFile);
-        return FALSE;
+void hostq_push_n(char** hostnames, int n)
+{
+    int pushed = 0;
+
+#ifdef USE_LOCKFREE_RING
+    // fast path, no lock at all
+    pushed = ring_push_n(&myQ, (void**)hostnames, n);
+    if (pushed > 0) {
+        hostq_wake(&myQNotEmpty, &myQNotEmptyWaiters, pushed);
+    }
+
+    while (pushed < n) {
+        // ring is full, sleep until a resolver frees some slots
+        int count;
+
+        pthread_mutex_lock(&myQWaitLock);
+        atomic_fetch_add(&myQNotFullWaiters, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        while ((count = ring_push_n(&myQ, (void**)hostnames + pushed, n - pushed)) == 0) {
+            pthread_cond_wait(&myQNotFull, &myQWaitLock);
+        }
+        atomic_fetch_sub(&myQNotFullWaiters, 1);
+        pthread_mutex_unlock(&myQWaitLock);
+
+        pushed += count;
+        hostq_wake(&myQNotEmpty, &myQNotEmptyWaiters, count);
+    }
+#else
+    // protect queue from being used by another thread
+    pthread_mutex_lock(&myQLock);
+
+    while (pushed < n) {
+        while (queue_is_full(&myQ)) {
+            // sleep and release the lock until a resolver frees a slot
+            pthread_cond_wait(&myQNotFull, &myQLock);
+        }
+        int count = queue_push_n(&myQ, (void**)hostnames + pushed, n - pushed);
+        pushed += count;
+
+        // wake as many resolvers as we handed work to
+        if (count > 1) {
+            pthread_cond_broadcast(&myQNotEmpty);
+        }
+        else {
+            pthread_cond_signal(&myQNotEmpty);
+        }
+    }
+
+    // release queue to be used by another thread
+    pthread_mutex_unlock(&myQLock);
+#endif
+}
+
+int hostq_try_pop_n(char** hostnames, int n)
+{
+    int popped;
+
+#ifdef USE_LOCKFREE_RING
+    popped = ring_pop_n(&myQ, (void**)hostnames, n);
+    if (popped) {
+        hostq_wake(&myQNotFull, &myQNotFullWaiters, popped);
     }
-    printf("reading %s from thread_id %ld\n", (char*)inputFile, pthread_self());
+#else
+    // protect queue from being used by another thread
+    pthread_mutex_lock(&myQLock);
 
-    /* Read File and Process*/
-    while (fscanf(inputfp, INPUTFS, hostname) > 0) {
-        int enqueueing = TRUE;
-        printf("Req> enqueuing %s\n", hostname);
+    popped = queue_pop_n(&myQ, (void**)hostnames, n);
+    if (popped > 1) {
+        pthread_cond_broadcast(&myQNotFull);
+    }
+    else if (popped) {
+        pthread_cond_signal(&myQNotFull);
+    }
 
-        while (enqueueing) {
-            // protect queue from being used by another thread
-            pthread_mutex_lock(&myQLock);
+    // release queue to be used by another thread
+    pthread_mutex_unlock(&myQLock);
+#endif
 
-            if (!queue_is_full(&myQ)) {
-                // allocate space for a new node to be enqueued
-                hostname_temp = malloc(MAX_NAME_LENGTH);
-                strncpy(hostname_temp, hostname, MAX_NAME_LENGTH);
+    return popped;
+}
 
-                if (queue_push(&myQ, hostname_temp) == QUEUE_FAILURE) {
-                    error_handler(ERROR_FAILED_TO_ENQUEUE, hostname_temp);
+int hostq_pop_n(char** hostnames, int n)
+{
+    int popped;
 
-                    // release queue to be used by another thread
-                    pthread_mutex_unlock(&myQLock);
+#ifdef USE_LOCKFREE_RING
+    // fast path, no lock at all
+    popped = ring_pop_n(&myQ, (void**)hostnames, n);
+    if (!popped) {
+        // ring is empty, sleep until a requester pushes or we shut down
+        pthread_mutex_lock(&myQWaitLock);
+        atomic_fetch_add(&myQNotEmptyWaiters, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (1) {
+            // read the flag before popping: requesters are joined before it
+            // drops, so a FALSE here means the ring can only shrink
+            int requesting = atomic_load(&stillRequesting);
+            popped         = ring_pop_n(&myQ, (void**)hostnames, n);
+            if (popped || !requesting) {
+                break;
+            }
+            pthread_cond_wait(&myQNotEmpty, &myQWaitLock);
+        }
+        atomic_fetch_sub(&myQNotEmptyWaiters, 1);
+        pthread_mutex_unlock(&myQWaitLock);
+    }
+    if (popped) {
+        hostq_wake(&myQNotFull, &myQNotFullWaiters, popped);
+    }
+#else
+    // protect queue from being used by another thread
+    pthread_mutex_lock(&myQLock);
 
-                    // failed to enqueue, free memory now or we will lose it
-                    free(hostname_temp);
+    while (queue_is_empty(&myQ) && stillRequesting) {
+        // sleep and release the lock until a requester pushes or we shut down
+        pthread_cond_wait(&myQNotEmpty, &myQLock);
+    }
+    // 0 here means empty and no one is requesting anymore
+    popped = queue_pop_n(&myQ, (void**)hostnames, n);
+    if (popped > 1) {
+        pthread_cond_broadcast(&myQNotFull);
+    }
+    else if (popped) {
+        pthread_cond_signal(&myQNotFull);
+    }
+
+    // release queue to be used by another thread
+    pthread_mutex_unlock(&myQLock);
+#endif
+
+    return popped;
+}
+
+void hostq_shutdown()
+{
+#ifdef USE_LOCKFREE_RING
+    atomic_store(&stillRequesting, FALSE);
+    pthread_mutex_lock(&myQWaitLock);
+    pthread_cond_broadcast(&myQNotEmpty);
+    pthread_mutex_unlock(&myQWaitLock);
+#else
+    pthread_mutex_lock(&myQLock);
+    stillRequesting = FALSE;
+    pthread_cond_broadcast(&myQNotEmpty);
+    pthread_mutex_unlock(&myQLock);
+#endif
+}
+
+size_t parse_size(const char* str)
+{
+    char*  suffix;
+    size_t size = strtoull(str, &suffix, 10);
+
+    switch (*suffix) {
+        case 'g':
+        case 'G':
+            size <<= 10;
+            // fall through
+        case 'm':
+        case 'M':
+            size <<= 10;
+            // fall through
+        case 'k':
+        case 'K':
+            size <<= 10;
+            break;
+
+        default:
+            break;
+    }
+    return size;
+}
+
+input_chunk* open_input_file(int index)
+{
+    const char*  path = inputPaths[index];
+    input_file*  file = calloc(1, sizeof(input_file));
+    input_chunk* head = NULL;
+    input_chunk* tail = NULL;
+    size_t       begin = 0;
+    int          chunks = 0;
+
+    if (!file) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+    // bogus input files are reported and skipped, like before
+    if (reader_map(&file->map, path) == READER_FAILURE) {
+        error_handler(ERROR_BOGUS_INPUT_FILE_PATH, (char*)path);
+        free(file);
+        if (ordered) {
+            // nothing to wait for from this file
+            reorder_file_opened(&outputOrder, index, 0);
+        }
+        return NULL;
+    }
+    file->path = path;
+    clock_gettime(CLOCK_MONOTONIC, &file->opened);
+
+    // the number of chunks follows the file size, not the file count
+    do {
+        input_chunk* chunk = malloc(sizeof(input_chunk));
+        if (!chunk) {
+            error_handler(ERROR_INIT, EMPTY_STRING);
+        }
+        chunk->file  = file;
+        chunk->id    = REORDER_CHUNK(index, chunks);
+        chunk->begin = begin;
+        chunk->end   = file->map.size;
+        chunk->next  = NULL;
+        if (splitBytes && file->map.size - begin > splitBytes) {
+            chunk->end = reader_align(&file->map, begin + splitBytes);
+        }
+
+        if (tail) {
+            tail->next = chunk;
+        }
+        else {
+            head = chunk;
+        }
+        tail  = chunk;
+        begin = chunk->end;
+        chunks++;
+    } while (begin < file->map.size);
+
+    atomic_init(&file->pending, chunks);
+    atomic_init(&file->names, 0);
+    if (ordered) {
+        reorder_file_opened(&outputOrder, index, chunks);
+    }
+
+    return head;
+}
+
+input_chunk* next_input_chunk()
+{
+    input_chunk* chunk;
+
+    pthread_mutex_lock(&workLock);
+    while (1) {
+        // chunks of files already open come first, so only about as many
+        // files as there are requesters are mapped at any time
+        if (workHead) {
+            chunk    = workHead;
+            workHead = chunk->next;
+            if (!workHead) {
+                workTail = NULL;
+            }
+            pthread_mutex_unlock(&workLock);
+            return chunk;
+        }
+        if (nextInputFile >= numberOfInputFiles) {
+            pthread_mutex_unlock(&workLock);
+            return NULL;
+        }
+
+        // open the next file outside the lock, keep its first chunk and
+        // share the rest with the pool
+        int index = nextInputFile++;
+        pthread_mutex_unlock(&workLock);
+
+        chunk = open_input_file(index);
+        pthread_mutex_lock(&workLock);
+        if (chunk) {
+            if (chunk->next) {
+                input_chunk* last = chunk->next;
+                while (last->next) {
+                    last = last->next;
+                }
+                if (workTail) {
+                    workTail->next = chunk->next;
+                }
+                else {
+                    workHead = chunk->next;
+                }
+                workTail = last;
+            }
+            pthread_mutex_unlock(&workLock);
+            chunk->next = NULL;
+            return chunk;
+        }
+    }
+}
+
+void finish_input_chunk(input_chunk* chunk, size_t names)
+{
+    input_file* file = chunk->file;
+
+    atomic_fetch_add(&file->names, names);
+    free(chunk);
+
+    // the last chunk read closes the file and reports its read throughput
+    if (atomic_fetch_sub(&file->pending, 1) == 1) {
+        struct timespec closed;
+        double          seconds;
+
+        clock_gettime(CLOCK_MONOTONIC, &closed);
+        seconds = (closed.tv_sec - file->opened.tv_sec) +
+                  (closed.tv_nsec - file->opened.tv_nsec) / 1e9;
+        printf("Req> read %s: %zu names, %zu bytes in %.6f s (%.2f MB/s, %.0f names/s)\n",
+               file->path,
+               atomic_load(&file->names),
+               file->map.size,
+               seconds,
+               seconds > 0 ? file->map.size / seconds / 1e6 : 0.0,
+               seconds > 0 ? atomic_load(&file->names) / seconds : 0.0);
+
+        // every name is copied out of the mapping by now
+        reader_unmap(&file->map);
+        free(file);
+    }
+}
+
+void* request(void* unused)
+{
+    const char*  hostname;  // view of the individual hostname in the mapping
+    size_t       length;
+    size_t       names;
+    char**       batch   = malloc(sizeof(char*) * batchSize);
+    int          batched = 0;
+    arena        arena;  // this thread's copies of the hostnames it enqueues
+    input_chunk* chunk;
+    input_cursor cursor;
+    reorder_key  key;  // input position of the hostname, in ordered mode
+
+    (void)unused;
+    if (!batch) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+    arena_init(&arena);
+
+    // keep taking the next unprocessed chunk until the work list runs out
+    while ((chunk = next_input_chunk()) != NULL) {
+        printf("reading %s [%zu, %zu) from thread_id %ld\n",
+               chunk->file->path,
+               chunk->begin,
+               chunk->end,
+               pthread_self());
+        reader_cursor_init(&cursor, &chunk->file->map, chunk->begin, chunk->end);
+        names = 0;
+
+        /* Read Chunk and Process*/
+        while (reader_next(&cursor, &hostname, &length)) {
+            printf("Req> enqueuing %.*s\n", (int)length, hostname);
+
+            if (ordered) {
+                key.chunk = chunk->id;
+                key.pos   = names;
+                // the input position travels with the copy
+                batch[batched] = arena_strndup_tagged(&arena, hostname, length, &key, sizeof(key));
+                if (batch[batched] && !reorder_admit(&outputOrder, &key, batch[batched], FALSE)) {
+                    // the reorder window is full. What we hold may be what
+                    // it is waiting for, so hand it over before sleeping.
+                    if (batched) {
+                        hostq_push_n(batch, batched);
+                        batch[0] = batch[batched];
+                        batched  = 0;
+                    }
+                    reorder_admit(&outputOrder, &key, batch[batched], TRUE);
                 }
-                printf("Req> %s enqueued Successfully \n", hostname_temp);
-                // release queue to be used by another thread
-                pthread_mutex_unlock(&myQLock);
-                enqueueing = FALSE;
             }
             else {
-                // release queue to be used by another thread
-                pthread_mutex_unlock(&myQLock);
-                usleep(USLEEP);
+                // first and only copy: exactly the hostname, into this thread's arena
+                batch[batched] = arena_strndup(&arena, hostname, length);
+            }
+            if (!batch[batched]) {
+                char failed[MAX_NAME_LENGTH];
+                snprintf(failed, sizeof(failed), "%.*s", (int)length, hostname);
+                error_handler(ERROR_FAILED_TO_ENQUEUE, failed);
+                continue;
+            }
+            names++;
+
+            // hand a full batch over in one go, blocks while the queue is full
+            if (++batched == batchSize) {
+                hostq_push_n(batch, batched);
+                batched = 0;
             }
         }
+        // flush the last partial batch
+        if (batched) {
+            hostq_push_n(batch, batched);
+            batched = 0;
+        }
+
+        // drop our hold on the chunk's last block, resolvers free it with
+        // the last name in it
+        arena_seal(&arena);
+        if (ordered) {
+            reorder_chunk_done(&outputOrder, chunk->id, names);
+        }
+        finish_input_chunk(chunk, names);
     }
-    /* Close Input File */
-    if (inputfp) {
-        fclose(inputfp);
-        printf("Closed input file %s\n", (char*)inputFile);
-    }
+
+    printf("Requester thread_id %ld done (%zu bytes in %zu arena blocks)\n",
+           pthread_self(),
+           arena.bytes,
+           arena.blocks);
+    free(batch);
 
     /* Exit, Returning NULL*/
     return NULL;
 }
 
-void* resolve(void* outputfp)
+void write_result(outbuf* output, char* hostname, const char* ip)
+{
+    reorder_key key;
+
+    if (ordered) {
+        // the window passes it on once everything before it is out
+        arena_tag(hostname, &key, sizeof(key));
+        if (reorder_put(&outputOrder, &key, hostname, ip) == REORDER_FAILURE) {
+            error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
+        }
+    }
+    // buffer the output line, handed to the writer thread in blocks
+    else if (outbuf_append(output, hostname, ip) == OUTBUF_FAILURE) {
+        error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
+    }
+    printf("Re$> resolved Successfully %s,%s\n", hostname, ip);
+    atomic_fetch_add_explicit(&resolvedCount, 1, memory_order_relaxed);
+
+    // release the queue node's payload we just popped, its arena
+    // block goes away with the last name in it
+    arena_free(hostname);
+}
+
+// about to go idle: hand over what we have so lines don't sit in memory
+// while there is no work
+static void flush_results(outbuf* output)
+{
+    if (ordered) {
+        reorder_flush(&outputOrder);
+    }
+    else {
+        outbuf_flush(output);
+    }
+}
+
+// a lookup finished, ip is NULL for a name that did not resolve
+static void lookup_done(outbuf* output, char* hostname, const char* ip)
+{
+    if (!ip) {
+        // can't resolve hostname. handle error, then continue.
+        error_handler(ERROR_BOGUS_HOSTNAME, hostname);
+
+        // set ip address to empty string to match program requirement
+        ip = EMPTY_STRING;
+    }
+    // bogus names are cached too, for a shorter while
+    if (cacheEntries) {
+        cache_put(&resultCache, hostname, ip);
+    }
+    if (diskCaching) {
+        diskcache_put(&resultFile, hostname, ip);
+    }
+    if (coalescing) {
+        // copies popped by other resolvers while we looked it up, each
+        // gets its own line. Taken before write_result() frees our copy.
+        flight_waiter* waiters = flight_finish(&inFlightNames, hostname);
+        char*          copy;
+
+        while ((copy = flight_next(&waiters)) != NULL) {
+            if (!ip[0]) {
+                error_handler(ERROR_BOGUS_HOSTNAME, copy);
+            }
+            write_result(output, copy, ip);
+        }
+    }
+    write_result(output, hostname, ip);
+}
+
+// answer a name from the cache or leave it with the lookup of the same name
+// already running, FALSE if we have to look it up
+static int skip_lookup(outbuf* output, char* hostname)
+{
+    char ip[MAX_IP_LENGTH];
+    int  rc = CACHE_MISS;
+
+    if (cacheEntries) {
+        rc = cache_get(&resultCache, hostname, ip, sizeof(ip));
+    }
+    if (rc == CACHE_MISS && diskCaching) {
+        // an earlier run, or another resolver process, may have it
+        switch (diskcache_get(&resultFile, hostname, ip, sizeof(ip))) {
+            case DISKCACHE_HIT:
+                rc = CACHE_HIT;
+                break;
+            case DISKCACHE_NEGATIVE_HIT:
+                rc = CACHE_NEGATIVE_HIT;
+                break;
+        }
+        if (rc != CACHE_MISS && cacheEntries) {
+            cache_put(&resultCache, hostname, ip);
+        }
+    }
+    if (rc == CACHE_MISS) {
+        return coalescing && flight_join(&inFlightNames, hostname) == FLIGHT_JOINED;
+    }
+    if (rc == CACHE_NEGATIVE_HIT) {
+        error_handler(ERROR_BOGUS_HOSTNAME, hostname);
+    }
+    write_result(output, hostname, ip);
+
+    return TRUE;
+}
+
+// dnsclient callback
+static void udp_lookup_done(void* output, void* hostname, const char* ip)
+{
+    lookup_done(output, hostname, ip);
+}
+
+// every address of a hostname, A and AAAA looked up side by side, as a
+// comma separated list. FALSE if the name has none.
+static int lookup_all(const char* hostname, char* ips, size_t size)
 {
-    char  firstipstr[MAX_IP_LENGTH];
+    dnsaddress addresses[UTIL_MAX_ADDRESSES];
+    int        count = dnslookup_dual(hostname, addresses, UTIL_MAX_ADDRESSES);
+
+    if (count == UTIL_FAILURE || !count) {
+        return FALSE;
+    }
+    dnsaddress_join(addresses, count, ips, (int)size);
+
+    return TRUE;
+}
+
+void resolve_blocking(outbuf* output, char** batch)
+{
+    char  firstipstr[MAX_IPS_LENGTH];
     char* hostname_fetched;
+    int   fetched;
 
     while (1) {
-        // protect queue from being used by another thread
-        pthread_mutex_lock(&myQLock);
-
-        if (!queue_is_empty(&myQ)) {
-            hostname_fetched = (char*)queue_pop(&myQ);
+        fetched = hostq_try_pop_n(batch, batchSize);
+        if (!fetched) {
+            flush_results(output);
 
-            // release queue to be used by another thread
-            pthread_mutex_unlock(&myQLock);
+            // blocks while the queue is empty, 0 once requesting is done
+            // and the queue is drained
+            fetched = hostq_pop_n(batch, batchSize);
+            if (!fetched) {
+                break;
+            }
+        }
 
+        for (int i = 0; i < fetched; i++) {
+            hostname_fetched = batch[i];
             printf("Re$> resolving %s\n", hostname_fetched);
+            if (skip_lookup(output, hostname_fetched)) {
+                continue;
+            }
 
-            if (hostname_fetched) {
-                /* Lookup hostname and get IP string */
-                if (dnslookup(hostname_fetched, firstipstr, sizeof(firstipstr)) == UTIL_FAILURE) {
-                    // can't resolve hostname. handle error, then continue.
-                    error_handler(ERROR_BOGUS_HOSTNAME, hostname_fetched);
+            /* Lookup hostname and get IP string */
+            if (allAddresses) {
+                lookup_done(output,
+                            hostname_fetched,
+                            lookup_all(hostname_fetched, firstipstr, sizeof(firstipstr)) ? firstipstr : NULL);
+            }
+            else if (resolver->lookup(hostname_fetched, firstipstr, sizeof(firstipstr)) == UTIL_FAILURE) {
+                lookup_done(output, hostname_fetched, NULL);
+            }
+            else {
+                lookup_done(output, hostname_fetched, firstipstr);
+            }
+        }
+    }
+}
 
-                    // set ip address to empty string to match program requirement
-                    strncpy(firstipstr, EMPTY_STRING, sizeof(firstipstr));
-                }
-                // protect output file from being used by another thread
-                pthread_mutex_lock(&outputFileLock);
+void resolve_udp(outbuf* output, char** batch)
+{
+    dnsclient client;
+    int       fetched;
 
-                // write to output file
-                fprintf((FILE*)outputfp, "%s,%s\n", hostname_fetched, firstipstr);
-                fflush((FILE*)outputfp);
-                printf("Re$> resolved Successfully %s,%s\n", hostname_fetched, firstipstr);
+    if (dnsclient_init(&client,
+                       &nameserver,
+                       nameserverLength,
+                       inFlight,
+                       DNSCLIENT_DEFAULT_TIMEOUT,
+                       retries,
+                       deadlineMillis,
+                       hedging,
+                       udp_lookup_done,
+                       output) == DNSCLIENT_FAILURE) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
 
-                // release output file to be used by another thread
-                pthread_mutex_unlock(&outputFileLock);
+    while (1) {
+        // only take as many names as we have room to send
+        int room = client.capacity - dnsclient_in_flight(&client);
+        if (room > ASYNC_SUBMIT_BATCH) {
+            room = ASYNC_SUBMIT_BATCH;
+        }
+
+        fetched = room ? hostq_try_pop_n(batch, room) : 0;
+        if (!fetched && !dnsclient_in_flight(&client)) {
+            flush_results(output);
+
+            // nothing in flight: block like the other resolvers, 0 once
+            // requesting is done and the queue is drained
+            fetched = hostq_pop_n(batch, room);
+            if (!fetched) {
+                break;
             }
+        }
 
-            // free allocated heap memory location allocated for
-            // the queue node's payload we just popped
-            free(hostname_fetched);
+        for (int i = 0; i < fetched; i++) {
+            printf("Re$> resolving %s\n", batch[i]);
+            if (skip_lookup(output, batch[i])) {
+                continue;
+            }
+            if (dnsclient_submit(&client, batch[i], batch[i]) == DNSCLIENT_FAILURE) {
+                // not a valid DNS name
+                lookup_done(output, batch[i], NULL);
+            }
         }
-        else {
-            // release queue to be used by another thread
-            pthread_mutex_unlock(&myQLock);
+
+        if (dnsclient_in_flight(&client)) {
+            // with names still coming only take the answers already there,
+            // otherwise sleep until one arrives
+            dnsclient_poll(&client, fetched ? 0 : ASYNC_IDLE_POLL_MILLIS);
         }
+    }
 
-        // protect queue from being used by another thread
-        pthread_mutex_lock(&myQLock);
+    printf("Resolver thread_id %ld udp: %zu sent, %zu retried, %zu hedged, %zu stray answers, "
+           "peak %d in flight\n",
+           pthread_self(),
+           client.sent,
+           client.retried,
+           client.hedgesSent,
+           client.stray,
+           client.peakInFlight);
+    printf("Resolver thread_id %ld udp: %zu answered (%zu after a retry, %zu by a hedge), "
+           "%zu failed (%zu timed out), hedging after %d ms\n",
+           pthread_self(),
+           client.answered,
+           client.recovered,
+           client.hedgeWins,
+           client.failed,
+           client.timedOut,
+           client.hedgeMillis);
+    dnsclient_cleanup(&client);
+}
 
-        // should we break?
-        if (queue_is_empty(&myQ) && !stillRequesting) {
-            // release queue to be used by another thread
-            pthread_mutex_unlock(&myQLock);
-            break;
+// getaddrinfo_a() notification, runs on a thread glibc starts for it
+static void gai_notify(union sigval value)
+{
+    gai_notifier* n = value.sival_ptr;
+
+    pthread_mutex_lock(&n->lock);
+    n->batches--;
+    n->notified++;
+    pthread_cond_signal(&n->finished);
+    pthread_mutex_unlock(&n->lock);
+}
+
+void resolve_gai(outbuf* output, char** batch)
+{
+    gai_slot*       slots       = malloc(sizeof(gai_slot) * inFlight);
+    int*            idle        = malloc(sizeof(int) * inFlight);  // free slot indexes
+    int*            active      = malloc(sizeof(int) * inFlight);
+    struct gaicb**  list        = malloc(sizeof(struct gaicb*) * ASYNC_SUBMIT_BATCH);
+    int             idleCount   = inFlight;
+    int             activeCount = 0;
+    char            firstipstr[MAX_IP_LENGTH];
+    gai_notifier    notifier;
+    struct sigevent notify;
+    size_t          submitted = 0, submits = 0, failed = 0;
+    size_t          depthSum = 0, depthSamples = 0;
+    int             peakInFlight = 0;
+    int             fetched, queued;
+
+    if (!slots || !idle || !active || !list) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+    for (int i = 0; i < inFlight; i++) {
+        idle[i] = i;
+    }
+    pthread_mutex_init(&notifier.lock, NULL);
+    pthread_cond_init(&notifier.finished, NULL);
+    notifier.batches  = 0;
+    notifier.notified = 0;
+    memset(&notify, 0, sizeof(notify));
+    notify.sigev_notify          = SIGEV_THREAD;
+    notify.sigev_notify_function = gai_notify;
+    notify.sigev_value.sival_ptr = &notifier;
+
+    while (1) {
+        size_t seen;
+        int    done = 0;
+
+        // only take as many names as we have free slots for
+        int room = idleCount < ASYNC_SUBMIT_BATCH ? idleCount : ASYNC_SUBMIT_BATCH;
+
+        fetched = room ? hostq_try_pop_n(batch, room) : 0;
+        if (!fetched && !activeCount) {
+            flush_results(output);
+
+            // nothing in flight: block like the other resolvers, 0 once
+            // requesting is done and the queue is drained
+            fetched = hostq_pop_n(batch, room);
+            if (!fetched) {
+                break;
+            }
+        }
+
+        queued = 0;
+        for (int i = 0; i < fetched; i++) {
+            gai_slot* slot;
+
+            printf("Re$> resolving %s\n", batch[i]);
+            if (skip_lookup(output, batch[i])) {
+                continue;
+            }
+            slot = &slots[idle[--idleCount]];
+            memset(&slot->request, 0, sizeof(slot->request));
+            slot->request.ar_name = batch[i];
+            slot->hostname        = batch[i];
+            list[queued++]        = &slot->request;
+            active[activeCount++] = slot - slots;
+        }
+
+        if (queued) {
+            // the whole batch goes to glibc's lookup threads in one call
+            pthread_mutex_lock(&notifier.lock);
+            notifier.batches++;
+            pthread_mutex_unlock(&notifier.lock);
+            if (dnslookup_submit(list, queued, &notify) == UTIL_FAILURE) {
+                // glibc could not allocate its requests
+                error_handler(ERROR_INIT, EMPTY_STRING);
+            }
+            submitted += queued;
+            submits++;
+            if (activeCount > peakInFlight) {
+                peakInFlight = activeCount;
+            }
+        }
+        depthSum += activeCount;
+        depthSamples++;
+
+        // take a notification count first, so one coming in while we look
+        // at the slots wakes us below
+        pthread_mutex_lock(&notifier.lock);
+        seen = notifier.notified;
+        pthread_mutex_unlock(&notifier.lock);
+
+        // write out every lookup that finished, batch notified or not
+        for (int i = 0; i < activeCount;) {
+            gai_slot* slot = &slots[active[i]];
+            int       rc   = dnslookup_result(&slot->request, firstipstr, sizeof(firstipstr));
+
+            if (rc == UTIL_IN_PROGRESS) {
+                i++;
+                continue;
+            }
+            if (rc == UTIL_FAILURE) {
+                failed++;
+            }
+            lookup_done(output, slot->hostname, rc == UTIL_FAILURE ? NULL : firstipstr);
+            idle[idleCount++] = active[i];
+            active[i]         = active[--activeCount];
+            done++;
         }
-        // release queue to be used by another thread
-        pthread_mutex_unlock(&myQLock);
+
+        if (!done && !fetched && activeCount) {
+            // sleep until a submission is done, or a while for the first
+            // lookups of one still running
+            struct timespec deadline;
+
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += ASYNC_IDLE_POLL_MILLIS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_mutex_lock(&notifier.lock);
+            while (notifier.notified == seen) {
+                if (pthread_cond_timedwait(&notifier.finished, &notifier.lock, &deadline) == ETIMEDOUT) {
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&notifier.lock);
+        }
+    }
+
+    // every lookup is written, but glibc may still be about to notify us
+    pthread_mutex_lock(&notifier.lock);
+    while (notifier.batches) {
+        pthread_cond_wait(&notifier.finished, &notifier.lock);
+    }
+    pthread_mutex_unlock(&notifier.lock);
+
+    printf("Resolver thread_id %ld getaddrinfo_a: %zu lookups in %zu submissions, %zu failed, "
+           "peak %d in flight, mean %.1f\n",
+           pthread_self(),
+           submitted,
+           submits,
+           failed,
+           peakInFlight,
+           depthSamples ? (double)depthSum / depthSamples : 0.0);
+    pthread_mutex_destroy(&notifier.lock);
+    pthread_cond_destroy(&notifier.finished);
+    free(slots);
+    free(idle);
+    free(active);
+    free(list);
+}
+
+void* resolve(void* unused)
+{
+    // the asynchronous backends pop in larger batches to keep their lookups
+    // in flight
+    int    batchCapacity = backend != BACKEND_GETADDRINFO && batchSize < ASYNC_SUBMIT_BATCH ? ASYNC_SUBMIT_BATCH : batchSize;
+    char** batch         = malloc(sizeof(char*) * batchCapacity);
+    outbuf output;  // this thread's pending output lines
+
+    (void)unused;
+    if (!batch || outbuf_init(&output, &outputWriter, flushBytes, flushMillis) == OUTBUF_FAILURE) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+
+    if (backend == BACKEND_UDP) {
+        resolve_udp(&output, batch);
+    }
+    else if (backend == BACKEND_GAI_A) {
+        resolve_gai(&output, batch);
+    }
+    else {
+        resolve_blocking(&output, batch);
+    }
+
+    if (outbuf_cleanup(&output) == OUTBUF_FAILURE) {
+        error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
     }
+    printf("Resolver thread_id %ld done (%zu bytes in %zu blocks)\n",
+           pthread_self(),
+           output.bytes,
+           output.blocks);
+    free(batch);
 
     /* Exit, Returning NULL*/
     return NULL;
@@ -263,53 +1122,338 @@ void* resolve(void* outputfp)
 
 int main(int argc, char* argv[])
 {
+    char* progname = argv[0];
+    int   opt;
+
+    /* Parse Options */
+    while ((opt = getopt(argc, argv, OPTSTRING)) != -1) {
+        switch (opt) {
+            case 'b':
+                // hostnames moved per queue critical section
+                batchSize = atoi(optarg);
+                if (batchSize < 1 || batchSize > MAX_BATCH_SIZE) {
+                    fprintf(stderr, "Batch size must be between 1 and %d\n", MAX_BATCH_SIZE);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'q':
+                queueBound = atoi(optarg);
+                if (queueBound < 1) {
+                    fprintf(stderr, "Queue bound must be at least 1\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'r':
+                // size of the requester pool
+                requesterCount = atoi(optarg);
+                if (requesterCount < MIN_REQUESTER_THREADS || requesterCount > MAX_REQUESTER_THREADS) {
+                    fprintf(stderr,
+                            "Requester threads must be between %d and %d\n",
+                            MIN_REQUESTER_THREADS,
+                            MAX_REQUESTER_THREADS);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'F':
+                // write output out once a thread buffered this much, 0 for
+                // every line
+                flushBytes = parse_size(optarg);
+                break;
+
+            case 'T':
+                // ... or once a buffered line is this old, -1 for no limit
+                flushMillis = atol(optarg);
+                break;
+
+            case 's':
+                // split input files into byte ranges of about this size
+                splitBytes = parse_size(optarg);
+                if (!splitBytes) {
+                    fprintf(stderr, "Split size must be positive\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'o':
+                // write lines in input order instead of completion order
+                ordered = TRUE;
+                break;
+
+            case 'w':
+                // cap on the reorder window, trades memory against
+                // requesters waiting on a slow lookup
+                windowBytes = parse_size(optarg);
+                break;
+
+            case 'B':
+                // how hostnames are resolved: blocking getaddrinfo() per
+                // thread or a stand-in for it, batches queued with glibc's
+                // getaddrinfo_a(), or our own UDP client with many queries
+                // in flight
+                if (!strcmp(optarg, "udp")) {
+                    backend = BACKEND_UDP;
+                }
+                else if (!strcmp(optarg, "gai_a")) {
+                    backend = BACKEND_GAI_A;
+                }
+                else {
+                    backend     = BACKEND_GETADDRINFO;
+                    backendSpec = optarg;
+                }
+                break;
+
+            case 'n':
+                nameserverAddress = optarg;
+                break;
+
+            case 'D':
+                // longest a udp lookup may take, retries included
+                deadlineMillis = atoi(optarg);
+                if (deadlineMillis < 1) {
+                    fprintf(stderr, "Deadline must be positive\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'R':
+                // times a lost udp query is sent again within its deadline
+                retries = atoi(optarg);
+                if (retries < 0) {
+                    fprintf(stderr, "Retries can't be negative\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'H':
+                // duplicate udp queries slower than most answers, the
+                // first answer wins
+                hedging = TRUE;
+                break;
+
+            case 'c':
+                // hostnames kept in the shared cache, 0 to look every
+                // occurrence up
+                cacheEntries = parse_size(optarg);
+                break;
+
+            case 't':
+                // seconds a resolved name is served from the cache
+                cacheTtl = atol(optarg);
+                break;
+
+            case 'N':
+                // ... and a name that did not resolve
+                negativeTtl = atol(optarg);
+                break;
+
+            case 'A':
+                // "host,ip1,ip2,..." with every IPv4 and IPv6 address
+                allAddresses = TRUE;
+                break;
+
+            case 'S':
+                // look up every copy of a name, even while another
+                // resolver is looking the same name up
+                coalescing = FALSE;
+                break;
+
+            case 'i':
+                // lookups each asynchronous resolver keeps going
+                inFlight = atoi(optarg);
+                if (inFlight < 1 || inFlight > DNSCLIENT_MAX_IN_FLIGHT) {
+                    fprintf(stderr, "Queries in flight must be between 1 and %d\n", DNSCLIENT_MAX_IN_FLIGHT);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'W':
+                // how the writer thread writes, io_uring falls back to
+                // writev by itself where the kernel refuses it
+                if (!strcmp(optarg, "writev")) {
+                    writerFlags |= WRITER_NO_URING;
+                }
+                else if (strcmp(optarg, "uring")) {
+                    fprintf(stderr, "Writer must be uring or writev\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            default:
+                fprintf(stderr, "Usage:\n %s %s\n", progname, USAGE);
+                return EXIT_FAILURE;
+        }
+    }
+    // from here on argv holds only the input files and the output file
+    argc -= optind - 1;
+    argv += optind - 1;
+
     /* Check Arguments */
     if (argc < MINARGS) {
         fprintf(stderr, "Not enough arguments: %d\n", (argc - 1));
-        fprintf(stderr, "Usage:\n %s %s\n", argv[0], USAGE);
+        fprintf(stderr, "Usage:\n %s %s\n", progname, USAGE);
         return EXIT_FAILURE;
     }
 
+    // any number of input files: a fixed-size requester pool takes them
+    // off the file list one by one
     numberOfInputFiles = argc - 2;
-    // check number of input files
-    if (numberOfInputFiles > MAX_INPUT_FILES) {
-        error_handler(ERROR_TOO_MANY_INPUT_FILES, EMPTY_STRING);
+    inputPaths         = &argv[1];
+    pthread_mutex_init(&workLock, NULL);
+
+    // by default one requester per input file up to the pool size; when
+    // splitting files, as many as we have cores for
+    if (!requesterCount) {
+        requesterCount = numberOfInputFiles;
+        if (requesterCount > REQUESTER_THREADS_COUNT) {
+            requesterCount = REQUESTER_THREADS_COUNT;
+        }
+        if (splitBytes) {
+            requesterCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        }
+    }
+    if (requesterCount < MIN_REQUESTER_THREADS) {
+        requesterCount = MIN_REQUESTER_THREADS;
+    }
+    if (requesterCount > MAX_REQUESTER_THREADS) {
+        requesterCount = MAX_REQUESTER_THREADS;
     }
+    printf("%d input files for %d requesting threads\n", numberOfInputFiles, requesterCount);
 
-    pthread_t reqThreads[REQUESTER_THREADS_COUNT];
-    pthread_t resThreads[RESOLVER_THREADS_COUNT];
+    pthread_t       reqThreads[MAX_REQUESTER_THREADS];
+    pthread_t       resThreads[RESOLVER_THREADS_COUNT];
+    struct timespec resolveStart, resolveEnd;
+    double          seconds;
 
+    if (backend == BACKEND_GETADDRINFO) {
+        // -B names the backend, else the environment does
+        resolver = dnsbackend_open(backendSpec ? backendSpec : getenv(UTIL_BACKEND_ENV));
+        if (!resolver) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (allAddresses) {
+        if (resolver != &dnsbackend_getaddrinfo) {
+            fprintf(stderr, "All addresses (-A) needs the getaddrinfo backend\n");
+            return EXIT_FAILURE;
+        }
+        // cache entries hold one address
+        cacheEntries = 0;
+    }
+
+    if (backend == BACKEND_UDP) {
+        // a handful of threads, each with thousands of queries in flight
+        resolverCount = ASYNC_RESOLVER_THREADS;
+        if (!inFlight) {
+            inFlight = DNSCLIENT_DEFAULT_IN_FLIGHT;
+        }
+        if (dnsclient_parse_server(nameserverAddress, &nameserver, &nameserverLength) == DNSCLIENT_FAILURE) {
+            fprintf(stderr, "Bad nameserver address: %s\n", nameserverAddress ? nameserverAddress : DNSCLIENT_RESOLV_CONF);
+            return EXIT_FAILURE;
+        }
+        printf("resolving over UDP, up to %d queries in flight per thread, %d ms deadline, "
+               "%d retries%s\n",
+               inFlight,
+               deadlineMillis,
+               retries,
+               hedging ? ", hedged" : "");
+    }
+    else if (backend == BACKEND_GAI_A) {
+        // the lookups run on glibc's threads, ours only submit and collect
+        resolverCount = ASYNC_RESOLVER_THREADS;
+        if (!inFlight) {
+            inFlight = GAI_DEFAULT_IN_FLIGHT;
+        }
+        printf("resolving with getaddrinfo_a, up to %d lookups in flight per thread\n", inFlight);
+    }
+
+    pthread_cond_init(&myQNotFull, NULL);
+    pthread_cond_init(&myQNotEmpty, NULL);
+
+#ifdef USE_LOCKFREE_RING
+    pthread_mutex_init(&myQWaitLock, NULL);
+
+    // init requests ring, capacity is rounded up to a power of two
+    if (ring_init(&myQ, queueBound) < queueBound) {
+        // failed to init ring
+        return FALSE;
+    }
+    printf("using lock-free ring of %d slots\n", myQ.maxSize);
+#else
     pthread_mutex_init(&myQLock, NULL);
-    pthread_mutex_init(&outputFileLock, NULL);
 
     // init requests queue
-    if (queue_init(&myQ, QUEUE_BOUND) != QUEUE_BOUND) {
+    if (queue_init(&myQ, queueBound) != queueBound) {
         // failed to init queue
         return FALSE;
     }
+#endif
+
+    if (cacheEntries &&
+        cache_init(&resultCache, cacheEntries, cacheTtl * 1000, negativeTtl * 1000) == CACHE_FAILURE) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+    // answers of a stand-in backend must not end up in the cache file
+    if (!allAddresses && (!resolver || resolver == &dnsbackend_getaddrinfo) && diskcache_path() &&
+        diskcache_open(&resultFile,
+                       diskcache_path(),
+                       DISKCACHE_DEFAULT_SLOTS,
+                       DISKCACHE_DEFAULT_TTL,
+                       DISKCACHE_DEFAULT_NEGATIVE_TTL) == DISKCACHE_SUCCESS) {
+        // without it every name is looked up, nothing else changes
+        diskCaching = TRUE;
+        printf("using cache file %s\n", diskcache_path());
+    }
+    if (coalescing) {
+        flight_init(&inFlightNames);
+    }
 
-    // create requesting threads, one per input file
-    for (int i = 0; i < numberOfInputFiles; i++) {
-        int rc = pthread_create(&reqThreads[i], NULL, request, argv[i + 1]);
+    // requesters report file and chunk sizes to the window as they go;
+    // nothing reaches the writer before the resolvers start
+    if (ordered &&
+        reorder_init(&outputOrder, &outputWriter, numberOfInputFiles, windowBytes, flushBytes, flushMillis) ==
+            REORDER_FAILURE) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+
+    // create the requesting thread pool, threads share the work list
+    for (int i = 0; i < requesterCount; i++) {
+        int rc = pthread_create(&reqThreads[i], NULL, request, NULL);
         if (rc) {
             printf("ERROR; return code from pthread_create() is %d\n", rc);
             error_handler(ERROR_THREAD_CREATION, EMPTY_STRING);
         }
         else {
-            printf("created requesting thread #%d, for input file %s\n", i, argv[i + 1]);
+            printf("created requesting thread #%d\n", i);
         }
     }
 
     /* Open Output File */
-    outputfp = fopen(argv[numberOfInputFiles + 1], "w");
-    if (!outputfp) {
+    // resolvers hand their blocks to a single writer thread, which lays
+    // them out at offsets of its own
+    outputfd = open(argv[numberOfInputFiles + 1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (outputfd < 0) {
         error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, argv[numberOfInputFiles + 1]);
         return FALSE;
     }
 
+    // one pool buffer per resolver plus room to queue writes behind them
+    if (writer_open(&outputWriter,
+                    outputfd,
+                    OUTBUF_BUFFER_SIZE(flushBytes),
+                    RESOLVER_THREADS_COUNT + WRITER_IN_FLIGHT,
+                    writerFlags) == WRITER_FAILURE) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+    printf("writer thread writing with %s\n", writer_mode(&outputWriter));
+
     // Create resolver threads
-    for (int i = 0; i < RESOLVER_THREADS_COUNT; ++i) {
-        int rc = pthread_create(&resThreads[i], NULL, resolve, outputfp);
+    clock_gettime(CLOCK_MONOTONIC, &resolveStart);
+    for (int i = 0; i < resolverCount; ++i) {
+        int rc = pthread_create(&resThreads[i], NULL, resolve, NULL);
         if (rc) {
             printf("ERROR; return code from pthread_create() is %d\n", rc);
             error_handler(ERROR_THREAD_CREATION, EMPTY_STRING);
@@ -318,36 +1462,111 @@ int main(int argc, char* argv[])
     }
 
     // Join on the request threads
-    for (int i = 0; i < numberOfInputFiles; i++) {
+    for (int i = 0; i < requesterCount; i++) {
         int rc = pthread_join(reqThreads[i], NULL);
         if (rc) {
             printf("ERROR; return code from pthread_join() is %d\n", rc);
             error_handler(ERROR_THREAD_JOINING, EMPTY_STRING);
         }
     }
+    pthread_mutex_destroy(&workLock);
 
-    // toggle requesting flag to indicate production completion
-    stillRequesting = FALSE;
+    // toggle requesting flag to indicate production completion and wake
+    // every idle resolver so it can drain the queue and exit
+    hostq_shutdown();
 
     // Join on the resolver threads
-    for (int i = 0; i < RESOLVER_THREADS_COUNT; ++i) {
+    for (int i = 0; i < resolverCount; ++i) {
         int rc = pthread_join(resThreads[i], NULL);
         if (rc) {
             printf("ERROR; return code from pthread_join() is %d\n", rc);
             error_handler(ERROR_THREAD_JOINING, EMPTY_STRING);
         }
     }
+    clock_gettime(CLOCK_MONOTONIC, &resolveEnd);
+    seconds = (resolveEnd.tv_sec - resolveStart.tv_sec) + (resolveEnd.tv_nsec - resolveStart.tv_nsec) / 1e9;
+    printf("Resolved %zu hostnames with %s in %.6f s (%.0f names/s)\n",
+           atomic_load(&resolvedCount),
+           backend == BACKEND_UDP ? "udp" : backend == BACKEND_GAI_A ? "getaddrinfo_a" : resolver->name,
+           seconds,
+           seconds > 0 ? atomic_load(&resolvedCount) / seconds : 0.0);
+
+    if (cacheEntries) {
+        cache_stats stats;
+
+        cache_stats_get(&resultCache, &stats);
+        printf("Cache: %zu hits, %zu negative hits, %zu misses (%zu expired), %zu evictions, %zu entries\n",
+               stats.hits,
+               stats.negativeHits,
+               stats.misses,
+               stats.expired,
+               stats.evictions,
+               stats.entries);
+        cache_cleanup(&resultCache);
+    }
+    if (diskCaching) {
+        printf("Cache file: %zu hits, %zu negative hits, %zu misses, %zu stored (%zu dropped)\n",
+               atomic_load(&resultFile.hits),
+               atomic_load(&resultFile.negativeHits),
+               atomic_load(&resultFile.misses),
+               atomic_load(&resultFile.stores),
+               atomic_load(&resultFile.busy));
+        diskcache_close(&resultFile);
+    }
+    if (coalescing) {
+        size_t leads, coalesced;
+
+        flight_stats(&inFlightNames, &leads, &coalesced);
+        printf("Single-flight: %zu lookups, %zu coalesced into one already running\n", leads, coalesced);
+        flight_cleanup(&inFlightNames);
+    }
+
+    if (ordered) {
+        // every line is in, the window must be empty by now
+        if (reorder_cleanup(&outputOrder) == REORDER_FAILURE) {
+            fprintf(stderr, "Reorder window still held lines at exit\n");
+        }
+        printf("Reorder window peak: %zu bytes in %zu lines (cap %zu bytes, %zu requester waits)\n",
+               atomic_load(&outputOrder.peakBytes),
+               outputOrder.peakCount,
+               windowBytes,
+               outputOrder.waits);
+    }
+
+    // every resolver handed its last block over, wait for the disk
+    if (writer_close(&outputWriter) == WRITER_FAILURE) {
+        error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
+    }
+    printf("Writer done (%zu bytes in %zu blocks, %zu calls with %s)\n",
+           outputWriter.bytes,
+           outputWriter.written,
+           outputWriter.calls,
+           writer_mode(&outputWriter));
+
+    // conditional variables clean up
+    pthread_cond_destroy(&myQNotFull);
+    pthread_cond_destroy(&myQNotEmpty);
 
+#ifdef USE_LOCKFREE_RING
+    // mutex locks clean up
+    pthread_mutex_destroy(&myQWaitLock);
+
+    // free up allocated memory for ring
+    ring_cleanup(&myQ);
+#else
     // mutex locks clean up
     pthread_mutex_destroy(&myQLock);
-    pthread_mutex_destroy(&outputFileLock);
 
     // free up allocated memory for queue
     queue_cleanup(&myQ);
+#endif
+    if (resolver) {
+        dnsbackend_close(resolver);
+    }
 
     // Close Output File if it's open
-    if (outputfp) {
-        fclose(outputfp);
+    if (outputfd >= 0) {
+        close(outputfd);
     }
 
     printf("All done! Goodbye.");
@@ -12,23 +12,148 @@
 #ifndef MULTI_LOOKUP_H
 #define MULTI_LOOKUP_H
 
+#include <stddef.h>
+
+struct outbuf_s;
+
+/**
+ * @brief push n hostnames into the requests queue, moving as many as fit
+ *          per critical section and sleeping while the queue is full. Uses
+ *          the lock-free ring when built with QUEUE=ring, the mutex guarded
+ *          queue otherwise.
+ * 
+ * @param hostnames array of heap allocated hostnames, ownership moves to
+ *          the queue.
+ * @param n number of hostnames in the array.
+ */
+void hostq_push_n(char** hostnames, int n);
+
+/**
+ * @brief pop up to n hostnames from the front of the requests queue
+ *          without sleeping.
+ * 
+ * @param hostnames array receiving the popped hostnames.
+ * @param n capacity of the array.
+ * @return int number of hostnames popped, 0 if the queue is empty.
+ */
+int hostq_try_pop_n(char** hostnames, int n);
+
+/**
+ * @brief pop up to n hostnames from the front of the requests queue in one
+ *          critical section, sleeping while the queue is empty and
+ *          requesters are still running.
+ * 
+ * @param hostnames array receiving the popped hostnames.
+ * @param n capacity of the array.
+ * @return int number of hostnames popped, 0 once hostq_shutdown() was
+ *          called and the queue is drained.
+ */
+int hostq_pop_n(char** hostnames, int n);
+
+/**
+ * @brief signal that all requesters are done and wake every sleeping
+ *          resolver so it can drain the queue and exit.
+ */
+void hostq_shutdown();
+
+/**
+ * @brief parse a byte count with an optional k, m or g suffix.
+ * 
+ * @param str the string to parse, e.g. "64m".
+ * @return size_t the byte count, 0 if it isn't a number.
+ */
+size_t parse_size(const char* str);
+
+/**
+ * @brief map an input file and cut it into chunks. With a split size set,
+ *          files larger than it are cut in byte ranges aligned to line
+ *          boundaries, otherwise the whole file is one chunk.
+ * 
+ * @param index index of the input file in the file list.
+ * @return input_chunk* linked list of the file's chunks, NULL if the file
+ *          can't be opened.
+ */
+struct input_chunk_s* open_input_file(int index);
+
 /**
- * @brief function to fetch each hostname in an input file,
- *          and enqueue it into our FIFO queue.
+ * @brief take the next chunk off the requesters' work list. Chunks of
+ *          files already open are handed out first; once there are none
+ *          left the next input file is opened.
  * 
- * @param inputFile pointer to input file of type FILE*.
+ * @return input_chunk* the chunk to read, NULL once every file is taken.
+ */
+struct input_chunk_s* next_input_chunk();
+
+/**
+ * @brief account for a fully read chunk. The last chunk of a file unmaps
+ *          it and reports its read throughput.
+ * 
+ * @param chunk the chunk, freed by this call.
+ * @param names number of hostnames read from it.
+ */
+void finish_input_chunk(struct input_chunk_s* chunk, size_t names);
+
+/**
+ * @brief requester pool thread: keep taking the next chunk off the
+ *          work list, fetch each hostname in it, and enqueue it into
+ *          our FIFO queue.
+ * 
+ * @param unused unused, chunks come from the shared work list.
  * @return void* returns NULL upon complete execution.
  */
-void* request(void* inputFile);
+void* request(void* unused);
+
+/**
+ * @brief write one result: in input order through the reorder window in
+ *          ordered mode, into the thread's output buffer otherwise. Frees
+ *          the hostname.
+ * 
+ * @param output the calling resolver's output buffer.
+ * @param hostname hostname popped off the queue.
+ * @param ip its IP address string, empty for a bogus hostname.
+ */
+void write_result(struct outbuf_s* output, char* hostname, const char* ip);
+
+/**
+ * @brief resolver loop of the getaddrinfo backend: one blocking lookup at
+ *          a time.
+ * 
+ * @param output the thread's output buffer.
+ * @param batch array of batchSize hostnames popped at once.
+ */
+void resolve_blocking(struct outbuf_s* output, char** batch);
+
+/**
+ * @brief resolver loop of the UDP backend: keeps up to inFlight queries
+ *          going on the thread's own DNS client and writes results as
+ *          answers come in.
+ * 
+ * @param output the thread's output buffer.
+ * @param batch array of at least ASYNC_SUBMIT_BATCH hostnames.
+ */
+void resolve_udp(struct outbuf_s* output, char** batch);
+
+/**
+ * @brief resolver loop of the getaddrinfo_a backend: queues each popped
+ *          batch with one getaddrinfo_a() call, keeps up to inFlight
+ *          lookups going on glibc's threads and writes results as they
+ *          finish.
+ * 
+ * @param output the thread's output buffer.
+ * @param batch array of at least ASYNC_SUBMIT_BATCH hostnames.
+ */
+void resolve_gai(struct outbuf_s* output, char** batch);
 
 /**
  * @brief function to resolve hostnames stores in FIFO queue
- *          and write each IP address to the output file.
+ *          and write each IP address to the output file. Names seen
+ *          before are answered from the shared cache. Lines are
+ *          buffered per thread and handed to the writer thread in blocks.
  * 
- * @param outputfp pointer to output file of type FILE*.
+ * @param unused unused, the writer thread owns the output file.
  * @return void* returns NULL upon complete execution.
  */
-void* resolve(void* outputfp);
+void* resolve(void* unused);
 
 /**
  * @brief function to handle errors.
@@ -0,0 +1,90 @@
+/**
+ * @file outbuf.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for per-thread output buffers. Each resolver thread
+ *          formats its "hostname,ip" lines into a buffer taken from the
+ *          writer stage's pool and hands it to the writer thread in large
+ *          blocks, resolvers never touch the output file.
+ * @version 0.1
+ * @date 2021-05-26
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "writer.h"
+
+#define OUTBUF_FAILURE -1
+#define OUTBUF_SUCCESS 0
+
+// longest line: hostname, comma, IPv6 address string and newline
+#define OUTBUF_MAX_NAME 1024
+#define OUTBUF_MAX_IP 735  // up to 16 IPv6 addresses, comma separated
+#define OUTBUF_MAX_LINE (OUTBUF_MAX_NAME + 1 + OUTBUF_MAX_IP + 1)
+
+// writer pool buffer size needed for a given flush size
+#define OUTBUF_BUFFER_SIZE(flushBytes) ((flushBytes) + OUTBUF_MAX_LINE)
+
+/**
+ * @brief a single thread's output buffer.
+ */
+typedef struct outbuf_s {
+    writer*         out;          // the writer stage, shared by all buffers
+    writer_buffer*  buffer;       // NULL until a line is added
+    size_t          flushBytes;   // hand over once this much is buffered
+    long            flushMillis;  // or once the oldest line is this old
+    struct timespec oldest;       // when the first pending line was added
+    size_t          blocks;       // buffers handed to the writer
+    size_t          bytes;        // bytes handed to the writer
+} outbuf;
+
+/**
+ * @brief initialize an output buffer.
+ *
+ * @param b pointer to the buffer.
+ * @param out the writer stage, its pool buffers must hold at least
+ *          OUTBUF_BUFFER_SIZE(flushBytes) bytes.
+ * @param flushBytes hand over once this many bytes are buffered, 0 hands
+ *          over every line.
+ * @param flushMillis hand over once the oldest buffered line is this many
+ *          milliseconds old, a negative value disables the time limit.
+ * @return int OUTBUF_SUCCESS on success, OUTBUF_FAILURE otherwise.
+ */
+int outbuf_init(outbuf* b, writer* out, size_t flushBytes, long flushMillis);
+
+/**
+ * @brief append a "hostname,ip" line, handing the buffer to the writer if
+ *          it reached its size or age limit. Sleeps while every pool buffer
+ *          is waiting to be written.
+ *
+ * @param b pointer to the buffer.
+ * @param hostname the hostname.
+ * @param ip the IP address string, empty for a bogus hostname.
+ * @return int OUTBUF_SUCCESS on success, OUTBUF_FAILURE once the writer
+ *          failed to write.
+ */
+int outbuf_append(outbuf* b, const char* hostname, const char* ip);
+
+/**
+ * @brief hand everything buffered to the writer.
+ *
+ * @param b pointer to the buffer.
+ * @return int OUTBUF_SUCCESS.
+ */
+int outbuf_flush(outbuf* b);
+
+/**
+ * @brief hand everything buffered to the writer before the thread exits.
+ *
+ * @param b pointer to the buffer.
+ * @return int OUTBUF_SUCCESS.
+ */
+int outbuf_cleanup(outbuf* b);
+
+#endif /* OUTBUF_H */
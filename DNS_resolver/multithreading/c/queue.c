@@ -92,6 +92,32 @@ int queue_push(queue* q, void* new_payload){
     return QUEUE_SUCCESS;
 }
 
+int queue_push_n(queue* q, void** payloads, int n){
+
+    int pushed = 0;
+
+    /* stop at the first full slot, the caller retries the rest */
+    while(pushed < n && !queue_is_full(q)){
+	q->array[q->rear].payload = payloads[pushed++];
+	q->rear = ((q->rear+1) % q->maxSize);
+    }
+
+    return pushed;
+}
+
+int queue_pop_n(queue* q, void** payloads, int n){
+
+    int popped = 0;
+
+    while(popped < n && !queue_is_empty(q)){
+	payloads[popped++] = q->array[q->front].payload;
+	q->array[q->front].payload = NULL;
+	q->front = ((q->front + 1) % q->maxSize);
+    }
+
+    return popped;
+}
+
 void queue_cleanup(queue* q)
 {
     while(!queue_is_empty(q)){
@@ -61,6 +61,16 @@ int queue_push(queue* q, void* payload);
  */
 void* queue_pop(queue* q);
 
+/* Function add up to n payloads to end of FIFO queue
+ * Returns the number of payloads pushed, 0 if the queue is full
+ */
+int queue_push_n(queue* q, void** payloads, int n);
+
+/* Function to return up to n elements from queue in FIFO order
+ * Returns the number of payloads popped, 0 if the queue is empty
+ */
+int queue_pop_n(queue* q, void** payloads, int n);
+
 /* Function to free queue memory */
 void queue_cleanup(queue* q);
 
@@ -0,0 +1,175 @@
+/**
+ * @file reader.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief memory-mapped input reader with a vectorized whitespace scan.
+ * @version 0.1
+ * @date 2021-05-25
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "reader.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define READER_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* same set as isspace() in the C locale: ' ', '\t', '\n', '\v', '\f', '\r' */
+static inline int reader_is_space(char c)
+{
+    return c == ' ' || (unsigned char)(c - '\t') <= ('\r' - '\t');
+}
+
+static const char* reader_scan_scalar(const char* pos, const char* end)
+{
+    while (pos < end && !reader_is_space(*pos)) {
+        pos++;
+    }
+    return pos;
+}
+
+#ifdef READER_HAVE_X86
+static const char* reader_scan_sse2(const char* pos, const char* end)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab   = _mm_set1_epi8('\t');
+    const __m128i range = _mm_set1_epi8('\r' - '\t');
+
+    while (end - pos >= 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)pos);
+        // '\t'..'\r' become 0..4, an unsigned min against 4 keeps only those
+        __m128i ctrl  = _mm_sub_epi8(bytes, tab);
+        __m128i hits  = _mm_or_si128(_mm_cmpeq_epi8(bytes, space),
+                                    _mm_cmpeq_epi8(_mm_min_epu8(ctrl, range), ctrl));
+        int     mask  = _mm_movemask_epi8(hits);
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return reader_scan_scalar(pos, end);
+}
+
+__attribute__((target("avx2"))) static const char* reader_scan_avx2(const char* pos,
+                                                                    const char* end)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab   = _mm256_set1_epi8('\t');
+    const __m256i range = _mm256_set1_epi8('\r' - '\t');
+
+    while (end - pos >= 32) {
+        __m256i  bytes = _mm256_loadu_si256((const __m256i*)pos);
+        __m256i  ctrl  = _mm256_sub_epi8(bytes, tab);
+        __m256i  hits  = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, space),
+                                       _mm256_cmpeq_epi8(_mm256_min_epu8(ctrl, range), ctrl));
+        unsigned mask  = (unsigned)_mm256_movemask_epi8(hits);
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    return reader_scan_sse2(pos, end);
+}
+#endif
+
+int reader_map(input_map* m, const char* path)
+{
+    struct stat st;
+    void*       data;
+    int         fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return READER_FAILURE;
+    }
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return READER_FAILURE;
+    }
+
+    m->data = NULL;
+    m->size = (size_t)st.st_size;
+
+    // an empty file has nothing to map, it simply yields no hostnames
+    if (m->size > 0) {
+        data = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror("Error mapping input file");
+            close(fd);
+            return READER_FAILURE;
+        }
+        madvise(data, m->size, MADV_SEQUENTIAL);
+        m->data = data;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+
+    return READER_SUCCESS;
+}
+
+void reader_unmap(input_map* m)
+{
+    if (m->data) {
+        munmap((void*)m->data, m->size);
+    }
+    m->data = NULL;
+    m->size = 0;
+}
+
+size_t reader_align(const input_map* m, size_t offset)
+{
+    const char* newline;
+
+    if (offset == 0 || offset >= m->size) {
+        return (offset == 0) ? 0 : m->size;
+    }
+
+    // a split right after a newline is already aligned
+    newline = memchr(m->data + offset - 1, '\n', m->size - (offset - 1));
+
+    return newline ? (size_t)(newline - m->data) + 1 : m->size;
+}
+
+void reader_cursor_init(input_cursor* c, const input_map* m, size_t begin, size_t end)
+{
+    c->pos  = m->data + begin;
+    c->end  = m->data + end;
+    c->scan = reader_scan_scalar;
+#ifdef READER_HAVE_X86
+    c->scan = __builtin_cpu_supports("avx2") ? reader_scan_avx2 : reader_scan_sse2;
+#endif
+}
+
+int reader_next(input_cursor* c, const char** name, size_t* len)
+{
+    const char* start = c->pos;
+    const char* stop;
+
+    // separators are usually a single newline, not worth vectorizing
+    while (start < c->end && reader_is_space(*start)) {
+        start++;
+    }
+    if (start == c->end) {
+        c->pos = start;
+        return 0;
+    }
+
+    // never look further than one maximum length token ahead
+    stop = (c->end - start > READER_MAX_TOKEN) ? start + READER_MAX_TOKEN : c->end;
+    stop = c->scan(start, stop);
+
+    *name  = start;
+    *len   = (size_t)(stop - start);
+    c->pos = stop;
+
+    return 1;
+}
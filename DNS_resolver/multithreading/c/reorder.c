@@ -0,0 +1,323 @@
+/**
+ * @file reorder.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief bounded reorder window putting resolved lines back in input order.
+ * @version 0.1
+ * @date 2021-05-28
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "reorder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRUE 1
+#define FALSE 0
+#define REORDER_MIN_HEAP 64
+
+static int key_less(const reorder_key* a, const reorder_key* b)
+{
+    return a->chunk < b->chunk || (a->chunk == b->chunk && a->pos < b->pos);
+}
+
+static int key_equal(const reorder_key* a, const reorder_key* b)
+{
+    return a->chunk == b->chunk && a->pos == b->pos;
+}
+
+// what an early line takes in the window, heap slot included
+static size_t entry_size(size_t hostLength, size_t ipLength)
+{
+    return sizeof(reorder_entry*) + sizeof(reorder_entry) + hostLength + ipLength + 2;
+}
+
+// what a name is charged from reorder_admit() to reorder_put(): the most
+// its line can take, whatever the address turns out to be
+static size_t admitted_size(const char* hostname)
+{
+    return entry_size(strnlen(hostname, OUTBUF_MAX_NAME), OUTBUF_MAX_IP);
+}
+
+// memory high-water mark of the window
+static void note_peak(reorder* r, size_t bytes)
+{
+    size_t peak = atomic_load_explicit(&r->peakBytes, memory_order_relaxed);
+
+    while (bytes > peak && !atomic_compare_exchange_weak(&r->peakBytes, &peak, bytes))
+        ;
+}
+
+static void heap_push(reorder* r, reorder_entry* e)
+{
+    size_t i = r->count++;
+
+    // sift up
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!key_less(&e->key, &r->heap[parent]->key)) {
+            break;
+        }
+        r->heap[i] = r->heap[parent];
+        i          = parent;
+    }
+    r->heap[i] = e;
+}
+
+static reorder_entry* heap_pop(reorder* r)
+{
+    reorder_entry* top  = r->heap[0];
+    reorder_entry* last = r->heap[--r->count];
+    size_t         i    = 0;
+
+    // sift the last entry down from the root
+    while (2 * i + 1 < r->count) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < r->count && key_less(&r->heap[child + 1]->key, &r->heap[child]->key)) {
+            child++;
+        }
+        if (!key_less(&r->heap[child]->key, &last->key)) {
+            break;
+        }
+        r->heap[i] = r->heap[child];
+        i          = child;
+    }
+    if (r->count) {
+        r->heap[i] = last;
+    }
+
+    return top;
+}
+
+// move next past everything we can: lines in the window that are next in
+// line, chunks fully written and files fully written. Called with the lock.
+static int reorder_advance(reorder* r)
+{
+    int rc = REORDER_SUCCESS;
+
+    while (r->next.chunk >> 32 < (uint64_t)r->fileCount) {
+        reorder_file* file  = &r->files[r->next.chunk >> 32];
+        uint32_t      chunk = (uint32_t)r->next.chunk;
+
+        if (file->chunks < 0) {
+            // not opened yet
+            break;
+        }
+        if ((long)chunk == file->chunks) {
+            // whole file written
+            free(file->names);
+            file->names   = NULL;
+            r->next.chunk = REORDER_CHUNK((r->next.chunk >> 32) + 1, 0);
+            r->next.pos   = 0;
+            continue;
+        }
+        if (r->count && key_equal(&r->heap[0]->key, &r->next)) {
+            reorder_entry* e = heap_pop(r);
+
+            if (outbuf_append(&r->output, e->data, e->ip) == OUTBUF_FAILURE) {
+                rc = REORDER_FAILURE;
+            }
+            atomic_fetch_sub(&r->bytes, e->size);
+            free(e);
+            r->next.pos++;
+            continue;
+        }
+        if (file->names[chunk] >= 0 && (uint64_t)file->names[chunk] == r->next.pos) {
+            // whole chunk written
+            r->next.chunk++;
+            r->next.pos = 0;
+            continue;
+        }
+        break;
+    }
+
+    if (r->waiters) {
+        pthread_cond_broadcast(&r->advanced);
+    }
+
+    return rc;
+}
+
+int reorder_init(reorder* r, writer* out, int files, size_t windowBytes, size_t flushBytes, long flushMillis)
+{
+    memset(r, 0, sizeof(*r));
+    r->fileCount   = files;
+    r->windowBytes = windowBytes;
+    r->capacity    = REORDER_MIN_HEAP;
+    r->files       = malloc(sizeof(reorder_file) * (files ? files : 1));
+    r->heap        = malloc(sizeof(reorder_entry*) * r->capacity);
+    if (!r->files || !r->heap) {
+        perror("Error on reorder window Malloc");
+        free(r->files);
+        free(r->heap);
+        return REORDER_FAILURE;
+    }
+    for (int i = 0; i < files; i++) {
+        r->files[i].chunks = -1;
+        r->files[i].names  = NULL;
+    }
+    atomic_init(&r->bytes, 0);
+    atomic_init(&r->peakBytes, 0);
+    outbuf_init(&r->output, out, flushBytes, flushMillis);
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->advanced, NULL);
+
+    return REORDER_SUCCESS;
+}
+
+void reorder_file_opened(reorder* r, int file, long chunks)
+{
+    long* names = chunks ? malloc(sizeof(long) * chunks) : NULL;
+
+    if (chunks && !names) {
+        perror("Error on reorder window Malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < chunks; i++) {
+        names[i] = -1;
+    }
+
+    pthread_mutex_lock(&r->lock);
+    r->files[file].names  = names;
+    r->files[file].chunks = chunks;
+    reorder_advance(r);
+    pthread_mutex_unlock(&r->lock);
+}
+
+void reorder_chunk_done(reorder* r, uint64_t chunk, size_t names)
+{
+    pthread_mutex_lock(&r->lock);
+    r->files[chunk >> 32].names[(uint32_t)chunk] = (long)names;
+    reorder_advance(r);
+    pthread_mutex_unlock(&r->lock);
+}
+
+int reorder_admit(reorder* r, const reorder_key* key, const char* hostname, int wait)
+{
+    size_t size  = admitted_size(hostname);
+    size_t bytes = atomic_load(&r->bytes);
+
+    // fast path, the window has room. Only admitted while it still does,
+    // so requesters racing here can't all get in on the same room.
+    while (bytes < r->windowBytes) {
+        if (atomic_compare_exchange_weak(&r->bytes, &bytes, bytes + size)) {
+            note_peak(r, bytes + size);
+            return TRUE;
+        }
+    }
+
+    pthread_mutex_lock(&r->lock);
+    if (wait) {
+        r->waits++;
+        r->waiters++;
+        // the name we wait for gets in anyway, or nothing would ever leave
+        while (atomic_load(&r->bytes) >= r->windowBytes && !key_equal(key, &r->next)) {
+            pthread_cond_wait(&r->advanced, &r->lock);
+        }
+        r->waiters--;
+    }
+    else {
+        wait = atomic_load(&r->bytes) < r->windowBytes || key_equal(key, &r->next);
+    }
+    if (wait) {
+        note_peak(r, atomic_fetch_add(&r->bytes, size) + size);
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return wait;
+}
+
+int reorder_put(reorder* r, const reorder_key* key, const char* hostname, const char* ip)
+{
+    int    rc       = REORDER_SUCCESS;
+    size_t admitted = admitted_size(hostname);
+
+    pthread_mutex_lock(&r->lock);
+    if (key_equal(key, &r->next)) {
+        atomic_fetch_sub(&r->bytes, admitted);
+
+        // in order: straight through, then whatever it was holding up
+        if (outbuf_append(&r->output, hostname, ip) == OUTBUF_FAILURE) {
+            rc = REORDER_FAILURE;
+        }
+        r->next.pos++;
+        if (reorder_advance(r) == REORDER_FAILURE) {
+            rc = REORDER_FAILURE;
+        }
+    }
+    else {
+        size_t         hostLength = strnlen(hostname, OUTBUF_MAX_NAME);
+        size_t         ipLength   = strnlen(ip, OUTBUF_MAX_IP);
+        size_t         size       = entry_size(hostLength, ipLength) - sizeof(reorder_entry*);
+        reorder_entry* e;
+
+        if (r->count == r->capacity) {
+            reorder_entry** heap = realloc(r->heap, sizeof(reorder_entry*) * r->capacity * 2);
+            if (!heap) {
+                atomic_fetch_sub(&r->bytes, admitted);
+                pthread_mutex_unlock(&r->lock);
+                perror("Error on reorder window Malloc");
+                return REORDER_FAILURE;
+            }
+            r->heap = heap;
+            r->capacity *= 2;
+        }
+        e = malloc(size);
+        if (!e) {
+            atomic_fetch_sub(&r->bytes, admitted);
+            pthread_mutex_unlock(&r->lock);
+            perror("Error on reorder window Malloc");
+            return REORDER_FAILURE;
+        }
+        e->key  = *key;
+        e->size = size + sizeof(reorder_entry*);
+        memcpy(e->data, hostname, hostLength);
+        e->data[hostLength] = '\0';
+        memcpy(e->data + hostLength + 1, ip, ipLength);
+        e->data[hostLength + 1 + ipLength] = '\0';
+        e->ip                              = e->data + hostLength + 1;
+        heap_push(r, e);
+
+        // the line takes no more than the name was charged
+        atomic_fetch_sub(&r->bytes, admitted - e->size);
+        if (r->count > r->peakCount) {
+            r->peakCount = r->count;
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return rc;
+}
+
+void reorder_flush(reorder* r)
+{
+    pthread_mutex_lock(&r->lock);
+    outbuf_flush(&r->output);
+    pthread_mutex_unlock(&r->lock);
+}
+
+int reorder_cleanup(reorder* r)
+{
+    int rc = r->count ? REORDER_FAILURE : REORDER_SUCCESS;
+
+    // only left over if a line never came: keep the rest, in order
+    while (r->count) {
+        reorder_entry* e = heap_pop(r);
+        outbuf_append(&r->output, e->data, e->ip);
+        free(e);
+    }
+    outbuf_cleanup(&r->output);
+
+    for (int i = 0; i < r->fileCount; i++) {
+        free(r->files[i].names);
+    }
+    free(r->files);
+    free(r->heap);
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->advanced);
+
+    return rc;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file reorder.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for the ordered front end of the writer stage.
+ *          Resolvers hand in lines tagged with their input position in any
+ *          order; lines are passed on to the writer in input order, the
+ *          ones that arrive early wait in a bounded reorder window. The
+ *          bound covers every name handed out and not written yet: a name
+ *          is charged the most its line can take from when it is admitted
+ *          until its line comes in.
+ * @version 0.1
+ * @date 2021-05-28
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef REORDER_H
+#define REORDER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+#include "writer.h"
+
+#define REORDER_FAILURE -1
+#define REORDER_SUCCESS 0
+
+// chunk ids: input file index in the high half, chunk index in the file in
+// the low half, so they compare in input order
+#define REORDER_CHUNK(file, chunk) (((uint64_t)(file) << 32) | (uint32_t)(chunk))
+
+/**
+ * @brief input position of a hostname.
+ */
+typedef struct reorder_key_s {
+    uint64_t chunk;  // REORDER_CHUNK(file, chunk)
+    uint64_t pos;    // position of the hostname in its chunk
+} reorder_key;
+
+/**
+ * @brief a line that arrived before the ones in front of it.
+ */
+typedef struct reorder_entry_s {
+    reorder_key key;
+    size_t      size;  // bytes accounted to the window
+    const char* ip;    // points into data, after the hostname
+    char        data[];
+} reorder_entry;
+
+/**
+ * @brief what is known about an input file's chunks.
+ */
+typedef struct reorder_file_s {
+    long  chunks;  // -1 until the file is opened
+    long* names;   // names per chunk, -1 until the chunk is read
+} reorder_file;
+
+/**
+ * @brief the reorder window.
+ */
+typedef struct reorder_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  advanced;  // the window got smaller
+    outbuf          output;    // lines in order, on their way to the writer
+    reorder_key     next;      // the line we are waiting for
+    reorder_file*   files;
+    int             fileCount;
+    reorder_entry** heap;  // min-heap on key
+    size_t          count;
+    size_t          capacity;
+    atomic_size_t   bytes;  // held by early lines and charged to names admitted and not resolved
+    size_t          windowBytes;  // admit no more names once bytes reach this
+    int             waiters;      // requesters sleeping in reorder_admit()
+    atomic_size_t   peakBytes;
+    size_t          peakCount;
+    size_t          waits;  // times a requester had to sleep
+} reorder;
+
+/**
+ * @brief initialize an empty reorder window.
+ *
+ * @param r pointer to the window.
+ * @param out the writer stage lines are handed to.
+ * @param files number of input files.
+ * @param windowBytes requesters stop admitting new names while the window
+ *          holds or is owed this much, except for the name the window waits
+ *          for. It never goes over by more than one name's charge.
+ * @param flushBytes hand ordered output over in blocks of this size.
+ * @param flushMillis or once the oldest line in a block is this old.
+ * @return int REORDER_SUCCESS on success, REORDER_FAILURE otherwise.
+ */
+int reorder_init(reorder* r, writer* out, int files, size_t windowBytes, size_t flushBytes, long flushMillis);
+
+/**
+ * @brief record how many chunks an input file was cut into, 0 if it could
+ *          not be opened.
+ *
+ * @param r pointer to the window.
+ * @param file input file index.
+ * @param chunks its number of chunks.
+ */
+void reorder_file_opened(reorder* r, int file, long chunks);
+
+/**
+ * @brief record how many names a chunk held once it is fully read.
+ *
+ * @param r pointer to the window.
+ * @param chunk REORDER_CHUNK() of the chunk.
+ * @param names number of names read from it.
+ */
+void reorder_chunk_done(reorder* r, uint64_t chunk, size_t names);
+
+/**
+ * @brief check whether a requester may hand out the name at key. Names are
+ *          admitted while the window is below its size, the name the window
+ *          waits for always is. An admitted name is charged to the window
+ *          until reorder_put() gets its line.
+ *
+ * @param r pointer to the window.
+ * @param key input position of the name.
+ * @param hostname the name, as it will be handed to reorder_put().
+ * @param wait sleep until the name is admitted instead of returning.
+ * @return int 1 if the name may be handed out, 0 if not (without wait).
+ */
+int reorder_admit(reorder* r, const reorder_key* key, const char* hostname, int wait);
+
+/**
+ * @brief hand in a resolved line. It goes to the writer right away if it is
+ *          the next one in input order, along with any early lines behind
+ *          it; otherwise it waits in the window.
+ *
+ * @param r pointer to the window.
+ * @param key input position of the hostname.
+ * @param hostname the hostname.
+ * @param ip the IP address string, empty for a bogus hostname.
+ * @return int REORDER_SUCCESS on success, REORDER_FAILURE if the line could
+ *          not be stored or the writer failed.
+ */
+int reorder_put(reorder* r, const reorder_key* key, const char* hostname, const char* ip);
+
+/**
+ * @brief hand the lines already in order to the writer.
+ *
+ * @param r pointer to the window.
+ */
+void reorder_flush(reorder* r);
+
+/**
+ * @brief hand everything left to the writer and free the window.
+ *
+ * @param r pointer to the window.
+ * @return int REORDER_SUCCESS if every line came out, REORDER_FAILURE if
+ *          lines were still waiting for a missing one.
+ */
+int reorder_cleanup(reorder* r);
+
+#endif /* REORDER_H */
@@ -0,0 +1,221 @@
+/**
+ * @file ring.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief lock-free bounded multi-producer/multi-consumer ring buffer.
+ * @version 0.1
+ * @date 2021-05-24
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RING_DEFAULT_SIZE 64
+
+int ring_init(ring* r, int size)
+{
+    // at least 2: with one slot, published (ticket + 1) and free for the
+    // next lap (ticket + capacity) are the same sequence
+    size_t capacity = 2;
+
+    if (size <= 0) {
+        size = RING_DEFAULT_SIZE;
+    }
+
+    // round up to a power of two, index wrapping is then a single AND
+    while (capacity < (size_t)size) {
+        capacity <<= 1;
+    }
+
+    r->array = malloc(sizeof(ring_cell) * capacity);
+    if (!r->array) {
+        perror("Error on ring Malloc");
+        return RING_FAILURE;
+    }
+
+    // slot i is first writable by the producer holding ticket i
+    for (size_t i = 0; i < capacity; i++) {
+        atomic_init(&r->array[i].sequence, i);
+        r->array[i].payload = NULL;
+    }
+
+    r->mask    = capacity - 1;
+    r->maxSize = (int)capacity;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+
+    return r->maxSize;
+}
+
+int ring_is_empty(ring* r)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    return (head == tail) ? 1 : 0;
+}
+
+int ring_push(ring* r, void* payload)
+{
+    ring_cell* cell;
+    size_t     pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    while (1) {
+        cell         = &r->array[pos & r->mask];
+        size_t seq   = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        long   delta = (long)seq - (long)pos;
+
+        if (delta == 0) {
+            // slot is free for this ticket, try to claim it
+            if (atomic_compare_exchange_weak_explicit(
+                    &r->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (delta < 0) {
+            // slot still holds an element from the previous lap: full
+            return RING_FAILURE;
+        }
+        else {
+            // another producer got here first, reload and retry
+            pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+        }
+    }
+
+    cell->payload = payload;
+    // publish the payload to the consumer holding ticket pos
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+
+    return RING_SUCCESS;
+}
+
+void* ring_pop(ring* r)
+{
+    ring_cell* cell;
+    void*      payload;
+    size_t     pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    while (1) {
+        cell         = &r->array[pos & r->mask];
+        size_t seq   = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        long   delta = (long)seq - (long)(pos + 1);
+
+        if (delta == 0) {
+            // slot holds a published element for this ticket, try to claim it
+            if (atomic_compare_exchange_weak_explicit(
+                    &r->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (delta < 0) {
+            // producer has not published this slot yet: empty
+            return NULL;
+        }
+        else {
+            // another consumer got here first, reload and retry
+            pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        }
+    }
+
+    payload = cell->payload;
+    // hand the slot back to the producer one lap ahead
+    atomic_store_explicit(&cell->sequence, pos + r->mask + 1, memory_order_release);
+
+    return payload;
+}
+
+int ring_push_n(ring* r, void** payloads, int n)
+{
+    size_t pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t count;
+
+    while (1) {
+        // count how many consecutive slots are free for tickets pos, pos+1..
+        for (count = 0; count < (size_t)n; count++) {
+            ring_cell* cell = &r->array[(pos + count) & r->mask];
+            size_t     seq  = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+            if (seq != pos + count) {
+                break;
+            }
+        }
+
+        if (count == 0) {
+            size_t seq = atomic_load_explicit(&r->array[pos & r->mask].sequence,
+                                              memory_order_acquire);
+            if ((long)seq - (long)pos < 0) {
+                // full
+                return 0;
+            }
+            // another producer got here first, reload and retry
+            pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+            continue;
+        }
+
+        // claim the whole run of tickets with a single CAS
+        if (atomic_compare_exchange_weak_explicit(
+                &r->head, &pos, pos + count, memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        ring_cell* cell = &r->array[(pos + i) & r->mask];
+        cell->payload   = payloads[i];
+        atomic_store_explicit(&cell->sequence, pos + i + 1, memory_order_release);
+    }
+
+    return (int)count;
+}
+
+int ring_pop_n(ring* r, void** payloads, int n)
+{
+    size_t pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t count;
+
+    while (1) {
+        // count how many consecutive slots are published for tickets pos..
+        for (count = 0; count < (size_t)n; count++) {
+            ring_cell* cell = &r->array[(pos + count) & r->mask];
+            size_t     seq  = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+            if (seq != pos + count + 1) {
+                break;
+            }
+        }
+
+        if (count == 0) {
+            size_t seq = atomic_load_explicit(&r->array[pos & r->mask].sequence,
+                                              memory_order_acquire);
+            if ((long)seq - (long)(pos + 1) < 0) {
+                // empty
+                return 0;
+            }
+            // another consumer got here first, reload and retry
+            pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+            continue;
+        }
+
+        // claim the whole run of tickets with a single CAS
+        if (atomic_compare_exchange_weak_explicit(
+                &r->tail, &pos, pos + count, memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        ring_cell* cell = &r->array[(pos + i) & r->mask];
+        payloads[i]     = cell->payload;
+        atomic_store_explicit(&cell->sequence, pos + i + r->mask + 1, memory_order_release);
+    }
+
+    return (int)count;
+}
+
+void ring_cleanup(ring* r)
+{
+    free(r->array);
+    r->array = NULL;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file ring.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for a lock-free bounded multi-producer/multi-consumer
+ *          ring buffer, a drop-in alternative to the mutex guarded queue.
+ * @version 0.1
+ * @date 2021-05-24
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#define RING_FAILURE -1
+#define RING_SUCCESS 0
+
+#define RING_CACHE_LINE_SIZE 64
+
+/**
+ * @brief a single slot of the ring. The sequence number tells producers and
+ *          consumers whose turn it is to touch the slot, so no lock is needed.
+ */
+typedef struct ring_cell_s {
+    atomic_size_t sequence;
+    void*         payload;
+} ring_cell;
+
+/**
+ * @brief bounded MPMC ring (D. Vyukov's algorithm). head is advanced by
+ *          producers and tail by consumers; each lives on its own cache line
+ *          (the struct alignment pads the tail) so the two sides don't
+ *          invalidate each other.
+ */
+typedef struct ring_s {
+    _Alignas(RING_CACHE_LINE_SIZE) ring_cell* array;
+    size_t mask;
+    int    maxSize;  // actual capacity, may exceed what ring_init() was asked for
+    _Alignas(RING_CACHE_LINE_SIZE) atomic_size_t head;
+    _Alignas(RING_CACHE_LINE_SIZE) atomic_size_t tail;
+} ring;
+
+/**
+ * @brief initialize a new ring. The capacity is rounded up to the next
+ *          power of two so indices wrap with a mask instead of a modulo,
+ *          and is at least 2, so maxSize can be bigger than size.
+ *
+ * @param r pointer to the ring to initialize.
+ * @param size requested capacity, a non-positive value selects the default.
+ * @return int the actual capacity on success, RING_FAILURE otherwise.
+ */
+int ring_init(ring* r, int size);
+
+/**
+ * @brief check if the ring is empty. Only a snapshot when other threads are
+ *          pushing or popping concurrently.
+ *
+ * @param r pointer to the ring.
+ * @return int 1 if empty, 0 otherwise.
+ */
+int ring_is_empty(ring* r);
+
+/**
+ * @brief add payload to the end of the ring. Safe to call from any number of
+ *          threads concurrently.
+ *
+ * @param r pointer to the ring.
+ * @param payload the payload to be enqueued, must not be NULL.
+ * @return int RING_SUCCESS on success, RING_FAILURE if the ring is full.
+ */
+int ring_push(ring* r, void* payload);
+
+/**
+ * @brief remove the front element of the ring in FIFO order. Safe to call
+ *          from any number of threads concurrently.
+ *
+ * @param r pointer to the ring.
+ * @return void* the popped payload, NULL if the ring is empty.
+ */
+void* ring_pop(ring* r);
+
+/**
+ * @brief add up to n payloads to the end of the ring, claiming all their
+ *          slots with a single CAS on head.
+ *
+ * @param r pointer to the ring.
+ * @param payloads array of n payloads, none of them NULL.
+ * @param n number of payloads in the array.
+ * @return int number of payloads pushed, 0 if the ring is full.
+ */
+int ring_push_n(ring* r, void** payloads, int n);
+
+/**
+ * @brief remove up to n elements from the front of the ring in FIFO order,
+ *          claiming all their slots with a single CAS on tail.
+ *
+ * @param r pointer to the ring.
+ * @param payloads array receiving up to n payloads.
+ * @param n capacity of the array.
+ * @return int number of payloads popped, 0 if the ring is empty.
+ */
+int ring_pop_n(ring* r, void** payloads, int n);
+
+/**
+ * @brief free ring memory. Payloads still stored are not freed.
+ *
+ * @param r pointer to the ring.
+ */
+void ring_cleanup(ring* r);
+
+#endif /* RING_H */
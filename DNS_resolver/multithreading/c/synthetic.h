@@ -0,0 +1,49 @@
+/**
+ * @file synthetic.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for the stand-in resolver backends. The synthetic
+ *          backend answers from a hosts or zone file, or with an address
+ *          made from the name, after a delay drawn from a latency
+ *          distribution, and fails a share of the lookups. Delay and failure
+ *          are drawn from a hash of the seed and the hostname, so a run is
+ *          the same whatever order the names are looked up in. Selected
+ *          with the backend spec
+ *          "synthetic:hosts=PATH,latency=DIST,fail=RATE,seed=N", every
+ *          option optional, DIST one of
+ *            fixed:MS
+ *            lognormal:MEDIAN_MS:SIGMA
+ *            bimodal:FAST_MS:SLOW_MS:SLOW_SHARE
+ *          The null backend answers at once, with an address made from the
+ *          name, or the one of its spec "null:ADDRESS", to measure what the
+ *          rest of the pipeline sustains.
+ * @version 0.1
+ * @date 2021-06-01
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include "util.h"
+
+#define SYNTHETIC_FIXED 0
+#define SYNTHETIC_LOGNORMAL 1
+#define SYNTHETIC_BIMODAL 2
+
+#define SYNTHETIC_MIN_SLOTS 1024  // hosts table, power of two
+#define SYNTHETIC_MAX_LINE 1024
+#define SYNTHETIC_MAX_MILLIS 60000.0  // longest delay a lookup gets
+
+/**
+ * @brief the synthetic backend, for dnsbackend_open().
+ */
+extern const dnsbackend synthetic_backend;
+
+/**
+ * @brief the null backend, for dnsbackend_open().
+ */
+extern const dnsbackend null_backend;
+
+#endif /* SYNTHETIC_H */
@@ -0,0 +1,152 @@
+/**
+ * @file writer.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for the output writer stage. Producers fill buffers
+ *          taken from a fixed pool and hand them over; a single writer
+ *          thread batches them into io_uring submissions on registered
+ *          buffers, or writev(2) calls where io_uring is not available, so
+ *          producers never touch the output file.
+ * @version 0.1
+ * @date 2021-05-27
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define WRITER_FAILURE -1
+#define WRITER_SUCCESS 0
+
+// writer_open() flags
+#define WRITER_APPEND 0x1    // fd is opened with O_APPEND and may be shared, one write at a time
+#define WRITER_NO_URING 0x2  // always write with writev(2)
+
+// submission ring size, also the most writes in flight at once
+#define WRITER_URING_ENTRIES 64
+// buffers the writer can have queued while every producer holds one
+#define WRITER_IN_FLIGHT 8
+// most buffers gathered into one writev(2) call
+#define WRITER_MAX_IOV 64
+
+/**
+ * @brief a pool buffer. Owned by one producer between writer_get() and
+ *          writer_submit(), by the writer thread after that.
+ */
+typedef struct writer_buffer_s {
+    char*                   data;
+    size_t                  used;     // bytes filled by the producer
+    size_t                  written;  // bytes the writer got out so far
+    off_t                   offset;   // file offset, unused with WRITER_APPEND
+    int                     index;    // index in the registered buffer table
+    int                     busy;     // handed to the kernel
+    struct writer_buffer_s* next;
+} writer_buffer;
+
+/**
+ * @brief io_uring rings, mapped from the kernel. fd is -1 when the writer
+ *          falls back to writev(2).
+ */
+typedef struct writer_uring_s {
+    int                  fd;
+    int                  registered;  // pool registered with IORING_REGISTER_BUFFERS
+    unsigned             entries;
+    void*                sqRing;
+    size_t               sqRingSize;
+    void*                cqRing;
+    size_t               cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t               sqesSize;
+    unsigned*            sqTail;
+    unsigned*            sqMask;
+    unsigned*            sqArray;
+    unsigned*            cqHead;
+    unsigned*            cqTail;
+    unsigned*            cqMask;
+    struct io_uring_cqe* cqes;
+} writer_uring;
+
+/**
+ * @brief the writer stage.
+ */
+typedef struct writer_s {
+    int             fd;
+    int             flags;
+    size_t          bufferSize;
+    int             bufferCount;
+    char*           pool;  // bufferCount buffers of bufferSize bytes
+    writer_buffer*  buffers;
+    pthread_mutex_t lock;      // guards the lists and flags below
+    pthread_cond_t  notEmpty;  // a buffer was submitted or the writer closes
+    pthread_cond_t  notFull;   // a buffer went back to the free list
+    writer_buffer*  freeList;
+    writer_buffer*  pendingHead;  // submitted, not taken by the writer yet
+    writer_buffer*  pendingTail;
+    int             closing;
+    int             failed;
+    off_t           offset;  // next file offset, only touched by the writer
+    pthread_t       thread;
+    writer_uring    ring;
+    const char*     mode;     // what the writer ended up using
+    size_t          bytes;    // bytes written
+    size_t          written;  // buffers written
+    size_t          calls;    // io_uring_enter(2) or writev(2) calls
+} writer;
+
+/**
+ * @brief set up a buffer pool and start the writer thread. Tries io_uring
+ *          first and falls back to writev(2) if the kernel refuses it.
+ *
+ * @param w pointer to the writer.
+ * @param fd output file descriptor, written at offsets tracked by the
+ *          writer unless WRITER_APPEND is set.
+ * @param bufferSize size of each pool buffer.
+ * @param bufferCount number of pool buffers, producers sleep in
+ *          writer_get() while all of them are queued.
+ * @param flags WRITER_APPEND and/or WRITER_NO_URING.
+ * @return int WRITER_SUCCESS on success, WRITER_FAILURE otherwise.
+ */
+int writer_open(writer* w, int fd, size_t bufferSize, int bufferCount, int flags);
+
+/**
+ * @brief take an empty buffer off the pool, sleeping while there is none.
+ *
+ * @param w pointer to the writer.
+ * @return writer_buffer* an empty buffer, NULL once a write failed.
+ */
+writer_buffer* writer_get(writer* w);
+
+/**
+ * @brief hand a filled buffer to the writer thread. The buffer goes back
+ *          to the pool once it is written.
+ *
+ * @param w pointer to the writer.
+ * @param b the buffer, taken with writer_get().
+ */
+void writer_submit(writer* w, writer_buffer* b);
+
+/**
+ * @brief wait for every submitted buffer to be written, stop the writer
+ *          thread and free the pool. No buffer may be submitted after this.
+ *
+ * @param w pointer to the writer.
+ * @return int WRITER_SUCCESS if everything was written, WRITER_FAILURE
+ *          otherwise.
+ */
+int writer_close(writer* w);
+
+/**
+ * @brief how the writer writes, for the statistics.
+ *
+ * @param w pointer to the writer.
+ * @return const char* "io_uring (registered buffers)", "io_uring" or
+ *          "writev".
+ */
+const char* writer_mode(const writer* w);
+
+#endif /* WRITER_H */
@@ -0,0 +1,117 @@
+/**
+ * @file arena.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief block arena for length-prefixed hostname records.
+ * @version 0.1
+ * @date 2021-05-24
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_RECORD_ALIGN sizeof(uint16_t)
+
+/* record layout: [uint16_t len][len bytes][NUL], 2 byte aligned */
+static size_t arena_record_size(size_t len)
+{
+    size_t size = sizeof(uint16_t) + len + 1;
+
+    return (size + ARENA_RECORD_ALIGN - 1) & ~(ARENA_RECORD_ALIGN - 1);
+}
+
+static arena_block* arena_block_of(const char* str)
+{
+    return (arena_block*)((uintptr_t)str & ~((uintptr_t)ARENA_BLOCK_SIZE - 1));
+}
+
+void arena_init(arena* a)
+{
+    a->current = NULL;
+    a->blocks  = 0;
+    a->bytes   = 0;
+}
+
+char* arena_strndup(arena* a, const char* str, size_t len)
+{
+    arena_block* block = a->current;
+    size_t       size  = arena_record_size(len);
+    uint16_t     prefix;
+    char*        record;
+
+    if (len > UINT16_MAX || offsetof(arena_block, data) + size > ARENA_BLOCK_SIZE) {
+        return NULL;
+    }
+
+    // start a new block if the record doesn't fit in the current one
+    if (!block || offsetof(arena_block, data) + block->used + size > ARENA_BLOCK_SIZE) {
+        arena_seal(a);
+
+        block = aligned_alloc(ARENA_BLOCK_SIZE, ARENA_BLOCK_SIZE);
+        if (!block) {
+            perror("Error on arena block Malloc");
+            return NULL;
+        }
+        atomic_init(&block->live, 0);
+        block->used      = 0;
+        block->allocated = 0;
+        a->current       = block;
+        a->blocks++;
+    }
+
+    record = block->data + block->used;
+    prefix = (uint16_t)len;
+    memcpy(record, &prefix, sizeof(prefix));
+    memcpy(record + sizeof(prefix), str, len);
+    record[sizeof(prefix) + len] = '\0';
+
+    block->used += size;
+    block->allocated++;
+    a->bytes += size;
+
+    return record + sizeof(prefix);
+}
+
+size_t arena_strlen(const char* str)
+{
+    uint16_t prefix;
+
+    memcpy(&prefix, str - sizeof(prefix), sizeof(prefix));
+
+    return prefix;
+}
+
+void arena_free(char* str)
+{
+    arena_block* block = arena_block_of(str);
+
+    // until the block is sealed live stays negative here, so only a release
+    // after the seal can bring it to zero
+    if (atomic_fetch_sub_explicit(&block->live, 1, memory_order_acq_rel) == 1) {
+        free(block);
+    }
+}
+
+void arena_seal(arena* a)
+{
+    arena_block* block = a->current;
+    long         allocated;
+
+    if (!block) {
+        return;
+    }
+    a->current = NULL;
+
+    // account for every record handed out; if all of them were already
+    // released this brings live to zero and the block is ours to free.
+    // Don't touch the block after the add unless we are the ones freeing it
+    allocated = (long)block->allocated;
+    if (atomic_fetch_add_explicit(&block->live, allocated, memory_order_acq_rel) == -allocated) {
+        free(block);
+    }
+}
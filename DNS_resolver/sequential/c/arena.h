@@ -0,0 +1,93 @@
+/**
+ * @file arena.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for a block arena holding length-prefixed hostname
+ *          records. Each requester thread owns one arena and copies every
+ *          hostname into it with an exact-length allocation; resolver threads
+ *          release records individually and a block is freed in bulk once
+ *          its owner sealed it and every record in it was released.
+ * @version 0.1
+ * @date 2021-05-24
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// must be a power of two, blocks are aligned to their size so a record can
+// find its block by masking its own address
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/**
+ * @brief a block of records. live counts records not yet released minus the
+ *          records the owner has not yet accounted for; it can only reach
+ *          zero after the owner sealed the block.
+ */
+typedef struct arena_block_s {
+    atomic_long live;
+    size_t      used;
+    size_t      allocated;  // records handed out, only touched by the owner
+    char        data[];
+} arena_block;
+
+/**
+ * @brief per-thread arena. Not safe to allocate from two threads at once,
+ *          releasing records is safe from any thread.
+ */
+typedef struct arena_s {
+    arena_block* current;
+    size_t       blocks;  // blocks allocated over the arena lifetime
+    size_t       bytes;   // record bytes handed out over the arena lifetime
+} arena;
+
+/**
+ * @brief initialize an empty arena, no memory is allocated until the first
+ *          record is copied in.
+ *
+ * @param a pointer to the arena.
+ */
+void arena_init(arena* a);
+
+/**
+ * @brief copy len bytes of str into the arena as a length-prefixed, NUL
+ *          terminated record.
+ *
+ * @param a pointer to the arena.
+ * @param str the string to copy, doesn't need to be NUL terminated.
+ * @param len number of bytes to copy, at most UINT16_MAX.
+ * @return char* the copied string, NULL on failure.
+ */
+char* arena_strndup(arena* a, const char* str, size_t len);
+
+/**
+ * @brief length of a string returned by arena_strndup(), read from the
+ *          record prefix.
+ *
+ * @param str string returned by arena_strndup().
+ * @return size_t its length.
+ */
+size_t arena_strlen(const char* str);
+
+/**
+ * @brief release a record. Its block is freed once it is sealed and all of
+ *          its records are released. Safe to call from any thread.
+ *
+ * @param str string returned by arena_strndup().
+ */
+void arena_free(char* str);
+
+/**
+ * @brief seal the current block, typically at the end of an input chunk.
+ *          The arena stays usable and starts a new block on the next copy.
+ *
+ * @param a pointer to the arena.
+ */
+void arena_seal(arena* a);
+
+#endif /* ARENA_H */
@@ -12,22 +12,26 @@
 #include "lookup.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "diskcache.h"
+#include "outbuf.h"
+#include "reader.h"
 #include "queue.h"
 #include "util.h"
+#include "writer.h"
 
 #define TRUE 1U
 #define FALSE 0U
-#define USLEEP 50U  // between 1 and 100, in microseconds
 #define MINARGS 3
 #define QUEUE_BOUND 1U
 #define EMPTY_STRING ""
-#define INPUTFS "%1024s"
 #define MAX_INPUT_FILES 10
 #define MAX_NAME_LENGTH 1025U
 #define MIN_RESOLVER_THREADS 1
@@ -37,6 +41,8 @@
 #define RESOLVER_THREADS_COUNT MAX_RESOLVER_THREADS
 #define REQUESTER_THREADS_COUNT MAX_REQUESTER_THREADS
 #define MAX_IP_LENGTH INET6_ADDRSTRLEN
+#define FLUSH_BYTES (64 * 1024)
+#define FLUSH_MILLIS 1000
 #define USAGE "<inputFilePath> <outputFilePath>"
 
 // internal error codes -- alter: make it an enum
@@ -54,9 +60,14 @@
 // Global static variables
 static queue           myQ;
 static pthread_mutex_t myQLock;
-static pthread_mutex_t outputFileLock;
-static FILE*           outputfp           = NULL;  //Holds the output file
-static int             stillRequesting    = TRUE;
+static pthread_cond_t  myQNotFull;
+static pthread_cond_t  myQNotEmpty;
+static int             outputfd           = -1;  //Holds the output file
+static writer          outputWriter;  // the only thread writing to outputfd
+static const dnsbackend* resolver         = NULL;  // from UTIL_BACKEND_ENV
+static diskcache       resultFile;  // results of earlier runs, mapped from disk
+static int             diskCaching        = FALSE;
+static int             stillRequesting    = TRUE;  // guarded by myQLock
 static int             numberOfInputFiles = 0;
 
 void error_handler(int error, char* str)
@@ -139,123 +150,151 @@ void error_handler(int error, char* str)
     }
 }
 
-void* request(void* inputFile)
+void hostq_push(char* hostname)
 {
-    char  hostname[MAX_NAME_LENGTH];  //Holds the individual hostname
-    char* hostname_temp;
-    FILE* inputfp = fopen((char*)inputFile, "r");
+    // protect queue from being used by another thread
+    pthread_mutex_lock(&myQLock);
 
-    // check input file stream
-    if (!inputfp) {
-        error_handler(ERROR_BOGUS_INPUT_FILE_PATH, (char*)inputFile);
-        return FALSE;
-    }
-    printf("reading %s from thread_id %ld\n", (char*)inputFile, pthread_self());
-
-    /* Read File and Process*/
-    while (fscanf(inputfp, INPUTFS, hostname) > 0) {
-        int enqueueing = TRUE;
-        printf("Req> enqueuing %s\n", hostname);
-
-        while (enqueueing) {
-            // protect queue from being used by another thread
-            pthread_mutex_lock(&myQLock);
-
-            if (!queue_is_full(&myQ)) {
-                // allocate space for a new node to be enqueued
-                hostname_temp = malloc(MAX_NAME_LENGTH);
-                strncpy(hostname_temp, hostname, MAX_NAME_LENGTH);
-
-                if (queue_push(&myQ, hostname_temp) == QUEUE_FAILURE) {
-                    error_handler(ERROR_FAILED_TO_ENQUEUE, hostname_temp);
-
-                    // release queue to be used by another thread
-                    pthread_mutex_unlock(&myQLock);
-
-                    // failed to enqueue, free memory now or we will lose it
-                    free(hostname_temp);
-                }
-                printf("Req> %s enqueued Successfully \n", hostname_temp);
-                // release queue to be used by another thread
-                pthread_mutex_unlock(&myQLock);
-                enqueueing = FALSE;
-            }
-            else {
-                // release queue to be used by another thread
-                pthread_mutex_unlock(&myQLock);
-                usleep(USLEEP);
-            }
-        }
+    while (queue_is_full(&myQ)) {
+        // sleep and release the lock until the resolver frees a slot
+        pthread_cond_wait(&myQNotFull, &myQLock);
     }
-    /* Close Input File */
-    if (inputfp) {
-        fclose(inputfp);
-        printf("Closed input file %s\n", (char*)inputFile);
+    if (queue_push(&myQ, hostname) == QUEUE_FAILURE) {
+        error_handler(ERROR_FAILED_TO_ENQUEUE, hostname);
     }
+    pthread_cond_signal(&myQNotEmpty);
 
-    /* Exit, Returning NULL*/
-    return NULL;
+    // release queue to be used by another thread
+    pthread_mutex_unlock(&myQLock);
 }
 
-void* resolve(void* outputfp)
+char* hostq_pop()
 {
-    char  firstipstr[MAX_IP_LENGTH];
-    char* hostname_fetched;
+    char* hostname;
 
-    while (1) {
-        // protect queue from being used by another thread
-        pthread_mutex_lock(&myQLock);
+    // protect queue from being used by another thread
+    pthread_mutex_lock(&myQLock);
 
-        if (!queue_is_empty(&myQ)) {
-            hostname_fetched = (char*)queue_pop(&myQ);
+    while (queue_is_empty(&myQ) && stillRequesting) {
+        // sleep and release the lock until a requester pushes or we shut down
+        pthread_cond_wait(&myQNotEmpty, &myQLock);
+    }
+    // NULL here means empty and no one is requesting anymore
+    hostname = (char*)queue_pop(&myQ);
+    if (hostname) {
+        pthread_cond_signal(&myQNotFull);
+    }
 
-            // release queue to be used by another thread
-            pthread_mutex_unlock(&myQLock);
+    // release queue to be used by another thread
+    pthread_mutex_unlock(&myQLock);
 
-            printf("Re$> resolving %s\n", hostname_fetched);
+    return hostname;
+}
 
-            if (hostname_fetched) {
-                /* Lookup hostname and get IP string */
-                if (dnslookup(hostname_fetched, firstipstr, sizeof(firstipstr)) == UTIL_FAILURE) {
-                    // can't resolve hostname. handle error, then continue.
-                    error_handler(ERROR_BOGUS_HOSTNAME, hostname_fetched);
+void hostq_shutdown()
+{
+    pthread_mutex_lock(&myQLock);
+    stillRequesting = FALSE;
+    pthread_cond_broadcast(&myQNotEmpty);
+    pthread_mutex_unlock(&myQLock);
+}
 
-                    // set ip address to empty string to match program requirement
-                    strncpy(firstipstr, EMPTY_STRING, sizeof(firstipstr));
-                }
-                // protect output file from being used by another thread
-                pthread_mutex_lock(&outputFileLock);
+void* request(void* inputFile)
+{
+    const char*  hostname;  // view of the individual hostname in the mapping
+    size_t       length;
+    char*        hostname_temp;
+    arena        names;  // this thread's copies of the hostnames it enqueues
+    input_map    input;
+    input_cursor cursor;
+
+    // check input file
+    if (reader_map(&input, (char*)inputFile) == READER_FAILURE) {
+        error_handler(ERROR_BOGUS_INPUT_FILE_PATH, (char*)inputFile);
+        return FALSE;
+    }
+    printf("reading %s from thread_id %ld\n", (char*)inputFile, pthread_self());
+    arena_init(&names);
+    reader_cursor_init(&cursor, &input, 0, input.size);
 
-                // write to output file
-                fprintf((FILE*)outputfp, "%s,%s\n", hostname_fetched, firstipstr);
-                fflush((FILE*)outputfp);
-                printf("Re$> resolved Successfully %s,%s\n", hostname_fetched, firstipstr);
+    /* Read File and Process*/
+    while (reader_next(&cursor, &hostname, &length)) {
+        printf("Req> enqueuing %.*s\n", (int)length, hostname);
+
+        // first and only copy: exactly the hostname, into this thread's arena
+        hostname_temp = arena_strndup(&names, hostname, length);
+        if (!hostname_temp) {
+            char failed[MAX_NAME_LENGTH];
+            snprintf(failed, sizeof(failed), "%.*s", (int)length, hostname);
+            error_handler(ERROR_FAILED_TO_ENQUEUE, failed);
+            continue;
+        }
 
-                // release output file to be used by another thread
-                pthread_mutex_unlock(&outputFileLock);
-            }
+        // blocks while the queue is full
+        hostq_push(hostname_temp);
+        printf("Req> %.*s enqueued Successfully \n", (int)length, hostname);
+    }
+
+    // drop our hold on the last block, the resolver frees it with the last name
+    arena_seal(&names);
+
+    /* Close Input File */
+    reader_unmap(&input);
+    printf("Closed input file %s (%zu bytes in %zu arena blocks)\n",
+           (char*)inputFile,
+           names.bytes,
+           names.blocks);
+
+    /* Exit, Returning NULL*/
+    return NULL;
+}
 
-            // free allocated heap memory location allocated for
-            // the queue node's payload we just popped
-            free(hostname_fetched);
+void* resolve(void* unused)
+{
+    char   firstipstr[MAX_IP_LENGTH];
+    char*  hostname_fetched;
+    outbuf output;  // pending output lines
+    int    cached;
+
+    (void)unused;
+    outbuf_init(&output, &outputWriter, FLUSH_BYTES, FLUSH_MILLIS);
+
+    // blocks while the queue is empty, NULL once requesting is done and
+    // the queue is drained
+    while ((hostname_fetched = hostq_pop()) != NULL) {
+        printf("Re$> resolving %s\n", hostname_fetched);
+
+        // an earlier run may have looked it up already
+        cached = diskCaching ? diskcache_get(&resultFile, hostname_fetched, firstipstr, sizeof(firstipstr))
+                             : DISKCACHE_MISS;
+        if (cached == DISKCACHE_NEGATIVE_HIT) {
+            error_handler(ERROR_BOGUS_HOSTNAME, hostname_fetched);
         }
-        else {
-            // release queue to be used by another thread
-            pthread_mutex_unlock(&myQLock);
+        else if (cached == DISKCACHE_MISS) {
+            /* Lookup hostname and get IP string */
+            if (resolver->lookup(hostname_fetched, firstipstr, sizeof(firstipstr)) == UTIL_FAILURE) {
+                // can't resolve hostname. handle error, then continue.
+                error_handler(ERROR_BOGUS_HOSTNAME, hostname_fetched);
+
+                // set ip address to empty string to match program requirement
+                strncpy(firstipstr, EMPTY_STRING, sizeof(firstipstr));
+            }
+            if (diskCaching) {
+                diskcache_put(&resultFile, hostname_fetched, firstipstr);
+            }
         }
 
-        // protect queue from being used by another thread
-        pthread_mutex_lock(&myQLock);
-
-        // should we break?
-        if (queue_is_empty(&myQ) && !stillRequesting) {
-            // release queue to be used by another thread
-            pthread_mutex_unlock(&myQLock);
-            break;
+        // buffer the output line, handed to the writer thread in blocks
+        if (outbuf_append(&output, hostname_fetched, firstipstr) == OUTBUF_FAILURE) {
+            error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
         }
-        // release queue to be used by another thread
-        pthread_mutex_unlock(&myQLock);
+        printf("Re$> resolved Successfully %s,%s\n", hostname_fetched, firstipstr);
+
+        // release the queue node's payload we just popped, its arena
+        // block goes away with the last name in it
+        arena_free(hostname_fetched);
     }
+    outbuf_cleanup(&output);
 
     /* Exit, Returning NULL*/
     return NULL;
@@ -279,8 +318,16 @@ int main(int argc, char* argv[])
     pthread_t reqThreads[REQUESTER_THREADS_COUNT];
     pthread_t resThreads[RESOLVER_THREADS_COUNT];
 
+    // getaddrinfo() unless the environment names a stand-in for it
+    resolver = dnsbackend_open(getenv(UTIL_BACKEND_ENV));
+    if (!resolver) {
+        return EXIT_FAILURE;
+    }
+    printf("resolving with the %s backend\n", resolver->name);
+
     pthread_mutex_init(&myQLock, NULL);
-    pthread_mutex_init(&outputFileLock, NULL);
+    pthread_cond_init(&myQNotFull, NULL);
+    pthread_cond_init(&myQNotEmpty, NULL);
 
     // init requests queue
     if (queue_init(&myQ, QUEUE_BOUND) != QUEUE_BOUND) {
@@ -301,15 +348,37 @@ int main(int argc, char* argv[])
     }
 
     /* Open Output File */
-    outputfp = fopen(argv[numberOfInputFiles + 1], "w");
-    if (!outputfp) {
+    outputfd = open(argv[numberOfInputFiles + 1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (outputfd < 0) {
         error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, argv[numberOfInputFiles + 1]);
         return FALSE;
     }
 
+    // the resolver hands its blocks to a writer thread, so lookups and
+    // disk writes overlap
+    if (writer_open(&outputWriter,
+                    outputfd,
+                    OUTBUF_BUFFER_SIZE(FLUSH_BYTES),
+                    RESOLVER_THREADS_COUNT + WRITER_IN_FLIGHT,
+                    0) == WRITER_FAILURE) {
+        error_handler(ERROR_INIT, EMPTY_STRING);
+    }
+
+    // results of earlier runs, shared with any other resolver running;
+    // answers of a stand-in backend must not end up there
+    if (resolver == &dnsbackend_getaddrinfo && diskcache_path() &&
+        diskcache_open(&resultFile,
+                       diskcache_path(),
+                       DISKCACHE_DEFAULT_SLOTS,
+                       DISKCACHE_DEFAULT_TTL,
+                       DISKCACHE_DEFAULT_NEGATIVE_TTL) == DISKCACHE_SUCCESS) {
+        diskCaching = TRUE;
+        printf("using cache file %s\n", diskcache_path());
+    }
+
     // Create resolver threads
     for (int i = 0; i < RESOLVER_THREADS_COUNT; ++i) {
-        int rc = pthread_create(&resThreads[i], NULL, resolve, outputfp);
+        int rc = pthread_create(&resThreads[i], NULL, resolve, NULL);
         if (rc) {
             printf("ERROR; return code from pthread_create() is %d\n", rc);
             error_handler(ERROR_THREAD_CREATION, EMPTY_STRING);
@@ -326,8 +395,9 @@ int main(int argc, char* argv[])
         }
     }
 
-    // toggle requesting flag to indicate production completion
-    stillRequesting = FALSE;
+    // toggle requesting flag to indicate production completion and wake
+    // the idle resolver so it can drain the queue and exit
+    hostq_shutdown();
 
     // Join on the resolver threads
     for (int i = 0; i < RESOLVER_THREADS_COUNT; ++i) {
@@ -338,16 +408,40 @@ int main(int argc, char* argv[])
         }
     }
 
+    // wait for the resolver's last block to reach the disk
+    if (writer_close(&outputWriter) == WRITER_FAILURE) {
+        error_handler(ERROR_BOGUS_OUTPUT_FILE_PATH, "write failed");
+    }
+    printf("Writer done (%zu bytes in %zu blocks, %zu calls with %s)\n",
+           outputWriter.bytes,
+           outputWriter.written,
+           outputWriter.calls,
+           writer_mode(&outputWriter));
+
+    if (diskCaching) {
+        printf("Cache file: %zu hits, %zu negative hits, %zu misses, %zu stored (%zu dropped)\n",
+               atomic_load(&resultFile.hits),
+               atomic_load(&resultFile.negativeHits),
+               atomic_load(&resultFile.misses),
+               atomic_load(&resultFile.stores),
+               atomic_load(&resultFile.busy));
+        diskcache_close(&resultFile);
+    }
+
     // mutex locks clean up
     pthread_mutex_destroy(&myQLock);
-    pthread_mutex_destroy(&outputFileLock);
+
+    // conditional variables clean up
+    pthread_cond_destroy(&myQNotFull);
+    pthread_cond_destroy(&myQNotEmpty);
 
     // free up allocated memory for queue
     queue_cleanup(&myQ);
+    dnsbackend_close(resolver);
 
     // Close Output File if it's open
-    if (outputfp) {
-        fclose(outputfp);
+    if (outputfd >= 0) {
+        close(outputfd);
     }
 
     printf("All done! Goodbye.");
@@ -12,6 +12,29 @@
 #ifndef LOOKUP_H
 #define LOOKUP_H
 
+/**
+ * @brief push a hostname into the requests queue, sleeping while the queue
+ *          is full.
+ * 
+ * @param hostname heap allocated hostname, ownership moves to the queue.
+ */
+void hostq_push(char* hostname);
+
+/**
+ * @brief pop the front hostname of the requests queue, sleeping while the
+ *          queue is empty and requesters are still running.
+ * 
+ * @return char* the popped hostname, NULL once hostq_shutdown() was called
+ *          and the queue is drained.
+ */
+char* hostq_pop();
+
+/**
+ * @brief signal that all requesters are done and wake the sleeping
+ *          resolver so it can drain the queue and exit.
+ */
+void hostq_shutdown();
+
 /**
  * @brief function to fetch each hostname in an input file,
  *          and enqueue it into our FIFO queue.
@@ -23,12 +46,13 @@ void* request(void* inputFile);
 
 /**
  * @brief function to resolve hostnames stores in FIFO queue
- *          and write each IP address to the output file.
+ *          and write each IP address to the output file. Lines are
+ *          buffered and handed to the writer thread in blocks.
  * 
- * @param outputfp pointer to output file of type FILE*.
+ * @param unused unused, the writer thread owns the output file.
  * @return void* returns NULL upon complete execution.
  */
-void* resolve(void* outputfp);
+void* resolve(void* unused);
 
 /**
  * @brief function to handle errors.
@@ -0,0 +1,83 @@
+/**
+ * @file outbuf.c
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief per-thread output buffers handed to the writer stage in large
+ *          blocks.
+ * @version 0.1
+ * @date 2021-05-26
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#include "outbuf.h"
+
+#include <string.h>
+
+static long outbuf_age_millis(const outbuf* b)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+    return (now.tv_sec - b->oldest.tv_sec) * 1000 + (now.tv_nsec - b->oldest.tv_nsec) / 1000000;
+}
+
+int outbuf_init(outbuf* b, writer* out, size_t flushBytes, long flushMillis)
+{
+    b->out         = out;
+    b->buffer      = NULL;
+    b->flushBytes  = flushBytes;
+    b->flushMillis = flushMillis;
+    b->blocks      = 0;
+    b->bytes       = 0;
+
+    return OUTBUF_SUCCESS;
+}
+
+int outbuf_append(outbuf* b, const char* hostname, const char* ip)
+{
+    size_t hostLength = strnlen(hostname, OUTBUF_MAX_NAME);
+    size_t ipLength   = strnlen(ip, OUTBUF_MAX_IP);
+    char*  line;
+
+    if (!b->buffer) {
+        // only hold a pool buffer while there is something in it
+        b->buffer = writer_get(b->out);
+        if (!b->buffer) {
+            return OUTBUF_FAILURE;
+        }
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &b->oldest);
+    }
+
+    line = b->buffer->data + b->buffer->used;
+    memcpy(line, hostname, hostLength);
+    line[hostLength] = ',';
+    memcpy(line + hostLength + 1, ip, ipLength);
+    line[hostLength + 1 + ipLength] = '\n';
+    b->buffer->used += hostLength + ipLength + 2;
+
+    if (b->buffer->used >= b->flushBytes ||
+        (b->flushMillis >= 0 && outbuf_age_millis(b) >= b->flushMillis)) {
+        return outbuf_flush(b);
+    }
+
+    return OUTBUF_SUCCESS;
+}
+
+int outbuf_flush(outbuf* b)
+{
+    if (b->buffer) {
+        b->bytes += b->buffer->used;
+        b->blocks++;
+        writer_submit(b->out, b->buffer);
+        b->buffer = NULL;
+    }
+
+    return OUTBUF_SUCCESS;
+}
+
+int outbuf_cleanup(outbuf* b)
+{
+    return outbuf_flush(b);
+}
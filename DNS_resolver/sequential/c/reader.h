@@ -0,0 +1,81 @@
+/**
+ * @file reader.h
+ * @author Feras Alshehri (falshehri@mail.csuchico.edu)
+ * @brief header file for the memory-mapped input reader. An input file is
+ *          mapped once and hostnames are handed out as pointer/length views
+ *          into the mapping, nothing is copied until a name is enqueued.
+ * @version 0.1
+ * @date 2021-05-25
+ *
+ * @copyright Copyright (c) 2021
+ *
+ */
+
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+
+#define READER_FAILURE -1
+#define READER_SUCCESS 0
+
+// longest hostname view handed out, longer tokens are split like "%1024s"
+#define READER_MAX_TOKEN 1024
+
+/**
+ * @brief a read-only mapping of a whole input file.
+ */
+typedef struct input_map_s {
+    const char* data;
+    size_t      size;
+} input_map;
+
+/**
+ * @brief a position inside a mapping. Each cursor is used by one thread,
+ *          several cursors can scan the same mapping concurrently.
+ */
+typedef struct input_cursor_s {
+    const char* pos;
+    const char* end;
+    const char* (*scan)(const char* pos, const char* end);
+} input_cursor;
+
+/**
+ * @brief map an input file read-only.
+ *
+ * @param m pointer to the mapping to fill in.
+ * @param path path of the input file, must be a regular file.
+ * @return int READER_SUCCESS on success, READER_FAILURE otherwise.
+ */
+int reader_map(input_map* m, const char* path);
+
+/**
+ * @brief unmap an input file. Views handed out from it become invalid.
+ *
+ * @param m pointer to the mapping.
+ */
+void reader_unmap(input_map* m);
+
+/**
+ * @brief start a cursor at byte begin of a mapping, stopping at byte end.
+ *          Picks the widest whitespace scanner the CPU supports (AVX2, SSE2
+ *          or scalar).
+ *
+ * @param c pointer to the cursor to initialize.
+ * @param m pointer to the mapping.
+ * @param begin offset of the first byte to scan.
+ * @param end offset one past the last byte to scan.
+ */
+void reader_cursor_init(input_cursor* c, const input_map* m, size_t begin, size_t end);
+
+/**
+ * @brief fetch the next whitespace separated hostname.
+ *
+ * @param c pointer to the cursor.
+ * @param name set to the first byte of the hostname, not NUL terminated.
+ * @param len set to the hostname length, at most READER_MAX_TOKEN.
+ * @return int 1 if a hostname was found, 0 at the end of the range.
+ */
+int reader_next(input_cursor* c, const char** name, size_t* len);
+
+#endif /* READER_H */
@@ -0,0 +1,300 @@
+'''
+filename.....: dns_stand_in.py
+brief........: stand-in DNS server for testing and benchmarking the
+                resolvers offline. By default it answers every A and AAAA
+                query on a local UDP port with an address derived from the
+                name; names under .invalid get NXDOMAIN.
+                It can also record the answers of a real nameserver for the
+                names of some input files, with the time each one took, into
+                a compact capture file, and later replay them with their
+                original timing, optionally scaled. Names missing from the
+                capture get NXDOMAIN at once.
+                Either way it can inject the delays and losses a real
+                resolver shows: a base delay with jitter, a share of slow
+                answers, and dropped queries.
+                usage: python3 dns_stand_in.py --port 5353 --drop 0.01
+                       --slow-rate 0.02 --slow-delay 1500
+                then: multi-lookup -B udp -n 127.0.0.1:5353 ...
+                record: python3 dns_stand_in.py --record capture.dnscap
+                        --upstream 8.8.8.8 DNS_resolver/input/*.txt
+                replay: python3 dns_stand_in.py --replay capture.dnscap
+                        --port 53 --scale 0.5
+author.......: Feras Alshehri
+email........: falshehri@mail.csuchico.edu
+last modified: 6/2/2021
+version......: 1.1
+'''
+import argparse
+import gzip
+import hashlib
+import heapq
+import random
+import select
+import socket
+import struct
+import time
+
+TYPE_A = 1
+TYPE_AAAA = 28
+CLASS_IN = 1
+ANSWER_TTL = 60
+FLAGS_OK = 0x8180           # response, recursion desired and available
+FLAGS_NXDOMAIN = 0x8183
+FLAG_RD = 0x0100
+HEADER = struct.Struct(">HHHHHH")
+
+# capture file: gzip of the magic, then one record per name and type,
+# followed by the name and the response. A response of length 0 means the
+# query was never answered.
+CAPTURE_MAGIC = b"DNSCAP1\n"
+CAPTURE_RECORD = struct.Struct(">HIBH")     # type, latency in us, name length, response length
+MAX_LATENCY_US = 0xffffffff
+
+
+def parse_args():
+    '''
+    parse the command line.
+    '''
+    parser = argparse.ArgumentParser(description = "stand-in DNS server with injected delays and drops")
+    parser.add_argument("--address", default = "127.0.0.1")
+    parser.add_argument("--port", type = int, default = 5353)
+    parser.add_argument("--delay", type = float, default = 0, help = "milliseconds before every answer")
+    parser.add_argument("--jitter", type = float, default = 0, help = "up to this many milliseconds more")
+    parser.add_argument("--slow-rate", type = float, default = 0, help = "share of answers that are slow")
+    parser.add_argument("--slow-delay", type = float, default = 1000, help = "milliseconds a slow answer takes")
+    parser.add_argument("--drop", type = float, default = 0, help = "share of queries never answered")
+    parser.add_argument("--seed", type = int, default = 1)
+    mode = parser.add_mutually_exclusive_group()
+    mode.add_argument("--record", metavar = "CAPTURE", help = "record the upstream's answers for the names in FILES")
+    mode.add_argument("--replay", metavar = "CAPTURE", help = "answer from a capture file")
+    parser.add_argument("--scale", type = float, default = 1, help = "replay latencies times this")
+    parser.add_argument("--upstream", default = "8.8.8.8", help = "nameserver to record, address[:port]")
+    parser.add_argument("--parallel", type = int, default = 64, help = "queries in flight while recording")
+    parser.add_argument("--timeout", type = float, default = 2, help = "seconds to wait for a recorded answer")
+    parser.add_argument("files", nargs = "*", help = "input files with the names to record")
+
+    return parser.parse_args()
+
+
+def parse_question(query):
+    '''
+    id, name, type and the raw question section of a query, None if it
+    isn't a query we answer.
+    '''
+    if len(query) < HEADER.size:
+        return None
+    qid, flags, qdcount = struct.unpack(">HHH", query[:6])
+    if flags & 0x8000 or qdcount != 1:
+        return None
+
+    labels = []
+    pos = HEADER.size
+    while pos < len(query) and query[pos]:
+        length = query[pos]
+        labels.append(query[pos + 1:pos + 1 + length].decode("ascii", "replace"))
+        pos += 1 + length
+    pos += 1
+    if pos + 4 > len(query):
+        return None
+    qtype = struct.unpack(">H", query[pos:pos + 2])[0]
+
+    return qid, ".".join(labels).lower(), qtype, query[HEADER.size:pos + 4]
+
+
+def synthetic_answer(query):
+    '''
+    the response to a query: a made-up but stable address for every name.
+    '''
+    qid, name, qtype, question = query
+    if name.endswith(".invalid"):
+        return HEADER.pack(qid, FLAGS_NXDOMAIN, 1, 0, 0, 0) + question
+
+    digest = hashlib.md5(name.encode()).digest()
+    record = b""
+    if qtype == TYPE_A:
+        record = struct.pack(">HHHIH", 0xc00c, TYPE_A, CLASS_IN, ANSWER_TTL, 4) + digest[:4]
+    elif qtype == TYPE_AAAA:
+        record = struct.pack(">HHHIH", 0xc00c, TYPE_AAAA, CLASS_IN, ANSWER_TTL, 16) + digest
+
+    return HEADER.pack(qid, FLAGS_OK, 1, 1 if record else 0, 0, 0) + question + record
+
+
+def replayed_answer(capture, scale, query):
+    '''
+    the recorded response to a query and its delay in milliseconds, None if
+    the recorded query went unanswered.
+    '''
+    qid, name, qtype, question = query
+    latency, response = capture.get((name, qtype), (0, None))
+    if response is None:
+        # never recorded
+        return HEADER.pack(qid, FLAGS_NXDOMAIN, 1, 0, 0, 0) + question, 0
+    if not response:
+        return None, 0
+
+    # the client's ID and question, the name's case included
+    answer = bytearray(response)
+    answer[0:2] = struct.pack(">H", qid)
+    if answer[HEADER.size:HEADER.size + len(question)].lower() == question.lower():
+        answer[HEADER.size:HEADER.size + len(question)] = question
+
+    return bytes(answer), latency / 1000 * scale
+
+
+def encode_query(qid, name, qtype):
+    '''
+    a recursive query for name, None if it isn't a valid DNS name.
+    '''
+    qname = b""
+    for label in name.rstrip(".").split("."):
+        if not label or len(label) > 63:
+            return None
+        qname += bytes([len(label)]) + label.encode("ascii", "replace")
+    if len(qname) + 1 > 255:
+        return None
+
+    return HEADER.pack(qid, FLAG_RD, 1, 0, 0, 0) + qname + b"\0" + struct.pack(">HH", qtype, CLASS_IN)
+
+
+def write_capture(path, capture):
+    '''
+    write recorded responses, {(name, type): (latency_us, response)}.
+    '''
+    with gzip.open(path, "wb") as f:
+        f.write(CAPTURE_MAGIC)
+        for (name, qtype), (latency, response) in sorted(capture.items()):
+            encoded = name.encode()
+            f.write(CAPTURE_RECORD.pack(qtype, min(latency, MAX_LATENCY_US), len(encoded), len(response)))
+            f.write(encoded + response)
+
+
+def read_capture(path):
+    '''
+    read a capture file written by write_capture().
+    '''
+    capture = {}
+    with gzip.open(path, "rb") as f:
+        data = f.read()
+    if not data.startswith(CAPTURE_MAGIC):
+        raise SystemExit(f"{path} is not a capture file")
+
+    pos = len(CAPTURE_MAGIC)
+    while pos + CAPTURE_RECORD.size <= len(data):
+        qtype, latency, name_length, response_length = CAPTURE_RECORD.unpack_from(data, pos)
+        pos += CAPTURE_RECORD.size
+        name = data[pos:pos + name_length].decode()
+        pos += name_length
+        capture[(name, qtype)] = (latency, data[pos:pos + response_length])
+        pos += response_length
+
+    return capture
+
+
+def record(args):
+    '''
+    ask the upstream for the A and AAAA records of every name in the input
+    files, a few queries in flight at a time, and save what came back.
+    '''
+    host, _, port = args.upstream.rpartition(":") if args.upstream.count(":") == 1 else (args.upstream, "", "")
+    upstream = (host, int(port) if port else 53)
+    names = []
+    for path in args.files:
+        with open(path) as f:
+            names += [line.strip().lower() for line in f if line.strip()]
+    todo = [(name, qtype) for name in dict.fromkeys(names) for qtype in (TYPE_A, TYPE_AAAA)]
+    todo.reverse()
+
+    sock = socket.socket(socket.AF_INET6 if ":" in upstream[0] else socket.AF_INET, socket.SOCK_DGRAM)
+    sock.connect(upstream)
+    rng = random.Random(args.seed)
+    capture = {}
+    pending = {}            # id -> (name, type, sent)
+    while todo or pending:
+        while todo and len(pending) < args.parallel:
+            name, qtype = todo.pop()
+            qid = rng.randrange(65536)
+            while qid in pending:
+                qid = rng.randrange(65536)
+            query = encode_query(qid, name, qtype)
+            if query:
+                sock.send(query)
+                pending[qid] = (name, qtype, time.monotonic())
+
+        if select.select([sock], [], [], 0.05)[0]:
+            response = sock.recv(4096)
+            qid = struct.unpack(">H", response[:2])[0] if len(response) >= 2 else -1
+            if qid in pending:
+                name, qtype, sent = pending.pop(qid)
+                capture[(name, qtype)] = (int((time.monotonic() - sent) * 1e6), response)
+
+        # unanswered queries are recorded as such
+        now = time.monotonic()
+        for qid, (name, qtype, sent) in list(pending.items()):
+            if now - sent > args.timeout:
+                del pending[qid]
+                capture[(name, qtype)] = (int(args.timeout * 1e6), b"")
+
+    write_capture(args.record, capture)
+    lost = sum(1 for _, response in capture.values() if not response)
+    print(f"recorded {len(capture)} responses for {len(names)} names from {args.upstream} "
+          f"({lost} unanswered) in {args.record}")
+
+
+def serve(args):
+    '''
+    answer queries until interrupted, each after its delay.
+    '''
+    rng = random.Random(args.seed)
+    capture = read_capture(args.replay) if args.replay else None
+    sock = socket.socket(socket.AF_INET6 if ":" in args.address else socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 8 << 20)
+    sock.bind((args.address, args.port))
+    if capture is not None:
+        print(f"replaying {len(capture)} responses from {args.replay} on {args.address}:{args.port}, "
+              f"latency x{args.scale}", flush = True)
+    else:
+        print(f"stand-in DNS server on {args.address}:{args.port}", flush = True)
+
+    pending = []            # (due, sequence, response, client)
+    sequence = received = dropped = slow = 0
+    try:
+        while True:
+            now = time.monotonic()
+            while pending and pending[0][0] <= now:
+                _, _, response, client = heapq.heappop(pending)
+                sock.sendto(response, client)
+
+            sock.settimeout(max(pending[0][0] - now, 0) if pending else None)
+            try:
+                packet, client = sock.recvfrom(4096)
+            except socket.timeout:
+                continue
+
+            query = parse_question(packet)
+            if not query:
+                continue
+            received += 1
+            if capture is not None:
+                response, delay = replayed_answer(capture, args.scale, query)
+            else:
+                response, delay = synthetic_answer(query), 0
+            if not response or rng.random() < args.drop:
+                dropped += 1
+                continue
+
+            delay += args.delay + rng.random() * args.jitter
+            if rng.random() < args.slow_rate:
+                slow += 1
+                delay += args.slow_delay
+            sequence += 1
+            heapq.heappush(pending, (time.monotonic() + delay / 1000, sequence, response, client))
+    except KeyboardInterrupt:
+        print(f"{received} queries, {dropped} dropped, {slow} slow")
+
+
+if __name__ == "__main__":
+    arguments = parse_args()
+    if arguments.record:
+        record(arguments)
+    else:
+        serve(arguments)
@@ -3,18 +3,29 @@ filename.....: performance_tester.py
 brief........: run all test recipes, capture measurements of each test,
                 and generate statistical values to be used for 
                 benchmark analaysis.
+                With --replay CAPTURE every test resolves through a replay of
+                recorded DNS answers (see dns_stand_in.py) served on
+                127.0.0.1:53, so all the languages face the same, repeatable
+                resolver. /etc/resolv.conf has to name 127.0.0.1 first.
+                usage: python3 performance_tester.py [grr iterations]
+                       [--replay CAPTURE [--replay-scale S]]
 author.......: Feras Alshehri
 email........: falshehri@mail.csuchico.edu
-last modified: 5/20/2021
-version......: 1.0
+last modified: 6/2/2021
+version......: 1.1
 '''
+import argparse
 import json
 import os
+import signal
+import subprocess
 import sys
 import time
 import statistics
 
 suppress_programs_output = True
+replay_address = "127.0.0.1"
+resolv_conf = "/etc/resolv.conf"
 
 def parse_test_plan(test_manifest = "test_recipes.json"):
     '''
@@ -172,19 +183,10 @@ def run_executable(cmd, n, stats_file):
     return
 
 
-def main():
+def run_tests(test_plan, grrIterations):
     '''
-    Entry point of the function.
+    run every test of the plan, grrIterations times.
     '''
-    test_plan = parse_test_plan()
-
-    grrIterations = 1
-    if len(sys.argv) > 1 and sys.argv[1].isdigit():
-        grrIterations = int(sys.argv[1])
-    
-    print(f"{grrIterations} grr iterations requested")
-    time.sleep(1)
-
     for grr in range(grrIterations):
         for test in test_plan:
             # time.sleep(1)
@@ -205,5 +207,82 @@ def main():
                                 stats_file)
 
 
+def first_nameserver(path = resolv_conf):
+    '''
+    the nameserver the system resolver asks first, None if there is none.
+    '''
+    try:
+        with open(path) as f:
+            for line in f:
+                fields = line.split()
+                if len(fields) > 1 and fields[0] == "nameserver":
+                    return fields[1]
+    except OSError:
+        pass
+
+    return None
+
+
+def start_replay_server(capture, scale):
+    '''
+    serve the capture on port 53 of the address the system resolver asks,
+    returns the server process, None if it can't be used.
+    '''
+    nameserver = first_nameserver()
+    if nameserver != replay_address:
+        print(f"{resolv_conf} sends queries to {nameserver}, not the replay server; "
+              f"put \"nameserver {replay_address}\" first in it")
+        return None
+
+    server = subprocess.Popen([sys.executable, "dns_stand_in.py", "--replay", capture,
+                               "--scale", str(scale), "--address", replay_address, "--port", "53"],
+                              stdout = subprocess.PIPE, text = True)
+    # the server says when it is listening
+    ready = server.stdout.readline()
+    if server.poll() is not None:
+        print("replay server failed to start (port 53 needs root)")
+        return None
+    print(ready, end = "")
+
+    return server
+
+
+def main():
+    '''
+    Entry point of the function.
+    '''
+    parser = argparse.ArgumentParser(description = "run the test recipes and collect statistics")
+    parser.add_argument("grr_iterations", nargs = "?", type = int, default = 1)
+    parser.add_argument("--replay", metavar = "CAPTURE", help = "resolve through a replay of this capture file")
+    parser.add_argument("--replay-scale", type = float, default = 1, help = "replay latencies times this")
+    args = parser.parse_args()
+
+    test_plan = parse_test_plan()
+
+    grrIterations = args.grr_iterations
+    
+    print(f"{grrIterations} grr iterations requested")
+
+    # every language does real lookups: the C programs must not answer
+    # from a cache file left by an earlier run
+    os.environ["DNS_RESOLVER_CACHE"] = ""
+
+    server = None
+    if args.replay:
+        server = start_replay_server(args.replay, args.replay_scale)
+        if not server:
+            sys.exit(1)
+        # the C programs must use the system resolver
+        os.environ.pop("DNS_RESOLVER_BACKEND", None)
+    time.sleep(1)
+
+    try:
+        run_tests(test_plan, grrIterations)
+    finally:
+        if server:
+            server.send_signal(signal.SIGINT)
+            print(server.communicate()[0], end = "")
+
+
 if __name__ == "__main__":
     main()
\ No newline at end of file